@@ -0,0 +1,199 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Sound effects. See audio.h.
+ */
+#include "audio.h"
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Clip lengths in samples. */
+#define MS(ms) ((ms) * AUDIO_SAMPLE_RATE / 1000)
+#define EAT_LENGTH MS(90)
+#define POWERUP_NOTE MS(70)
+#define POWERUP_NOTES 4
+#define POWERUP_LENGTH (POWERUP_NOTE * POWERUP_NOTES)
+#define GAMEOVER_LENGTH MS(800)
+
+/* Peak level of a clip. Four voices at this level stay just inside
+ * the 16-bit range. */
+#define CLIP_PEAK 8000.0f
+
+static int16_t eat_clip[EAT_LENGTH];
+static int16_t powerup_clip[POWERUP_LENGTH];
+static int16_t gameover_clip[GAMEOVER_LENGTH];
+
+static const int16_t *const clips[SOUND_COUNT] = {eat_clip, powerup_clip, gameover_clip};
+static const uint32_t clip_lengths[SOUND_COUNT] = {EAT_LENGTH, POWERUP_LENGTH, GAMEOVER_LENGTH};
+static bool clip_ready[SOUND_COUNT];
+
+static int16_t sample(float v)
+{
+    return (int16_t)lrintf(v * CLIP_PEAK);
+}
+
+/* Eat: a short blip rising an octave, fading out. */
+static void synth_eat(void)
+{
+    float phase = 0.0f;
+    for (int i = 0; i < EAT_LENGTH; i++)
+    {
+        float t = (float)i / EAT_LENGTH;
+        phase += 2.0f * (float)M_PI * (600.0f + 600.0f * t) / AUDIO_SAMPLE_RATE;
+        eat_clip[i] = sample(sinf(phase) * (1.0f - t));
+    }
+}
+
+/* Power-up: a rising C major arpeggio in triangle waves. */
+static void synth_powerup(void)
+{
+    static const float notes[POWERUP_NOTES] = {523.25f, 659.25f, 783.99f, 1046.50f};
+    for (int n = 0; n < POWERUP_NOTES; n++)
+    {
+        float phase = 0.0f;
+        for (int i = 0; i < POWERUP_NOTE; i++)
+        {
+            float t = (float)i / POWERUP_NOTE;
+            phase += notes[n] / AUDIO_SAMPLE_RATE;
+            float frac = phase - floorf(phase);
+            float tri = 4.0f * fabsf(frac - 0.5f) - 1.0f;
+            powerup_clip[n * POWERUP_NOTE + i] = sample(tri * (1.0f - 0.6f * t));
+        }
+    }
+}
+
+/* Game over: a falling two-octave sweep with a third harmonic for some
+ * buzz, decaying slowly. The pitch falls by a constant ratio per
+ * sample rather than a powf() each. */
+static void synth_gameover(void)
+{
+    const float fall = powf(0.25f, 1.0f / GAMEOVER_LENGTH);
+    float phase = 0.0f, step = 2.0f * (float)M_PI * 392.0f / AUDIO_SAMPLE_RATE;
+    for (int i = 0; i < GAMEOVER_LENGTH; i++)
+    {
+        float t = (float)i / GAMEOVER_LENGTH;
+        phase += step;
+        step *= fall;
+        float v = 0.75f * sinf(phase) + 0.25f * sinf(3.0f * phase);
+        gameover_clip[i] = sample(v * (1.0f - t) * (1.0f - t));
+    }
+}
+
+static void (*const synths[SOUND_COUNT])(void) = {synth_eat, synth_powerup, synth_gameover};
+
+/* Synthesize a clip the first time it plays. */
+static void clip_prepare(uint8_t sound)
+{
+    if (!clip_ready[sound])
+    {
+        synths[sound]();
+        clip_ready[sound] = true;
+    }
+}
+
+void audio_init(void)
+{
+    for (int c = 0; c < SOUND_COUNT; c++)
+        clip_ready[c] = false;
+}
+
+void audio_play(audio_voices_t *voices, sound_t sound)
+{
+    int pick = 0;
+    for (int v = 0; v < AUDIO_VOICES; v++)
+    {
+        if (voices->sound[v] == SOUND_NONE)
+        {
+            pick = v;
+            break;
+        }
+        if (voices->pos[v] > voices->pos[pick])
+            pick = v;
+    }
+    clip_prepare((uint8_t)sound);
+    voices->sound[pick] = (uint8_t)sound;
+    voices->pos[pick] = 0;
+}
+
+void audio_stop(audio_voices_t *voices)
+{
+    for (int v = 0; v < AUDIO_VOICES; v++)
+    {
+        voices->sound[v] = SOUND_NONE;
+        voices->pos[v] = 0;
+    }
+}
+
+bool audio_voice_valid(uint8_t sound, uint32_t pos)
+{
+    if (sound == SOUND_NONE)
+        return pos == 0;
+    return sound < SOUND_COUNT && pos < clip_lengths[sound];
+}
+
+bool audio_mix(const audio_voices_t *voices, int16_t *out, unsigned out_frames, unsigned frames)
+{
+    const int16_t *clip[AUDIO_VOICES];
+    uint32_t pos[AUDIO_VOICES], length[AUDIO_VOICES];
+    int live = 0;
+    for (int v = 0; v < AUDIO_VOICES; v++)
+    {
+        if (voices->sound[v] == SOUND_NONE)
+            continue;
+        /* A voice loaded from a state may not have played here yet. */
+        clip_prepare(voices->sound[v]);
+        clip[live] = clips[voices->sound[v]];
+        pos[live] = voices->pos[v];
+        length[live] = clip_lengths[voices->sound[v]];
+        live++;
+    }
+    if (!live)
+        return false;
+
+    /* Source position of each output frame, in 16.16 samples. */
+    uint32_t step = out_frames ? (uint32_t)(((uint64_t)frames << 16) / out_frames) : 0;
+    uint32_t src = 0;
+    for (unsigned i = 0; i < out_frames; i++, src += step)
+    {
+        int32_t acc = 0;
+        for (int v = 0; v < live; v++)
+        {
+            uint32_t p = pos[v] + (src >> 16);
+            if (p < length[v])
+                acc += clip[v][p];
+        }
+        if (acc > INT16_MAX)
+            acc = INT16_MAX;
+        else if (acc < INT16_MIN)
+            acc = INT16_MIN;
+        out[2 * i] = out[2 * i + 1] = (int16_t)acc;
+    }
+    return true;
+}
+
+void audio_advance(audio_voices_t *voices, unsigned frames)
+{
+    for (int v = 0; v < AUDIO_VOICES; v++)
+    {
+        if (voices->sound[v] == SOUND_NONE)
+            continue;
+        voices->pos[v] += frames;
+        if (voices->pos[v] >= clip_lengths[voices->sound[v]])
+        {
+            voices->sound[v] = SOUND_NONE;
+            voices->pos[v] = 0;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Sound effects. Every sound is synthesized into a mono 16-bit clip
+ * the first time it plays; playing one starts a voice on it. A mix adds the
+ * live voices in 32-bit integers and writes stereo frames, so nothing
+ * is allocated or cleared per frame, and audio_mix() does no work at
+ * all while every voice is idle.
+ *
+ * Voices advance by game time (audio_advance()), independent of how
+ * many frames the frontend is given: audio_mix() stretches the same
+ * span over more or fewer output frames when the frontend's buffer
+ * runs low or high. The voices are plain values, so they can be saved
+ * with the game and play on exactly as before after a load.
+ */
+#ifndef SNEK_AUDIO_H
+#define SNEK_AUDIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AUDIO_SAMPLE_RATE 48000
+/* Sounds that can play at once; a new one replaces the oldest. */
+#define AUDIO_VOICES 4
+
+typedef enum
+{
+    SOUND_EAT,
+    SOUND_POWERUP,
+    SOUND_GAMEOVER,
+    SOUND_COUNT
+} sound_t;
+
+/* Idle voices have sound SOUND_NONE. */
+#define SOUND_NONE 0xFF
+
+typedef struct
+{
+    uint8_t sound[AUDIO_VOICES];
+    uint32_t pos[AUDIO_VOICES]; /* samples into the clip */
+} audio_voices_t;
+
+/* Forget the clips; each is synthesized again when next played. */
+void audio_init(void);
+
+/* Start a sound. */
+void audio_play(audio_voices_t *voices, sound_t sound);
+
+void audio_stop(audio_voices_t *voices);
+
+/* Whether a saved voice is valid. */
+bool audio_voice_valid(uint8_t sound, uint32_t pos);
+
+/* Mix the next frames samples of the voices into out_frames stereo
+ * frames at out, stretching or squeezing them to fit. Returns false
+ * without writing anything if no voice is playing. Does not advance
+ * the voices. */
+bool audio_mix(const audio_voices_t *voices, int16_t *out, unsigned out_frames, unsigned frames);
+
+/* Move the voices on by frames samples; finished ones go idle. */
+void audio_advance(audio_voices_t *voices, unsigned frames);
+
+#endif
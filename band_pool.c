@@ -0,0 +1,174 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Band worker pool. See band_pool.h.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "band_pool.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define BAND_POOL_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+    band_pool_t *pool;
+    int index;
+#ifdef BAND_POOL_THREADS
+    pthread_t thread;
+#endif
+} band_worker_t;
+
+struct band_pool
+{
+    int threads;
+    band_worker_t *workers; /* threads - 1 of them; the caller is thread 0 */
+
+    /* The job being run. */
+    band_job_t job;
+    void *data;
+
+#ifdef BAND_POOL_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finished;
+    unsigned generation;
+    int pending;
+    bool quit;
+#endif
+};
+
+#ifdef BAND_POOL_THREADS
+static void *band_worker(void *arg)
+{
+    band_worker_t *worker = (band_worker_t *)arg;
+    band_pool_t *pool = worker->pool;
+    unsigned seen = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->quit)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->quit)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->job(pool->data, worker->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->finished);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+#endif
+
+band_pool_t *band_pool_create(int threads)
+{
+    band_pool_t *pool = (band_pool_t *)calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->threads = 1;
+#ifdef BAND_POOL_THREADS
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > 1)
+    {
+        pool->workers = (band_worker_t *)calloc((size_t)threads - 1, sizeof(band_worker_t));
+        if (!pool->workers)
+        {
+            free(pool);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+    for (int t = 1; t < threads; t++)
+    {
+        band_worker_t *worker = &pool->workers[t - 1];
+        worker->pool = pool;
+        worker->index = t;
+        if (pthread_create(&worker->thread, NULL, band_worker, worker) != 0)
+            break;
+        pool->threads++;
+    }
+#else
+    (void)threads;
+#endif
+    return pool;
+}
+
+void band_pool_destroy(band_pool_t *pool)
+{
+    if (!pool)
+        return;
+#ifdef BAND_POOL_THREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 1; t < pool->threads; t++)
+        pthread_join(pool->workers[t - 1].thread, NULL);
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    free(pool->workers);
+    free(pool);
+}
+
+int band_pool_threads(const band_pool_t *pool)
+{
+    return pool->threads;
+}
+
+void band_pool_run(band_pool_t *pool, band_job_t job, void *data)
+{
+    pool->job = job;
+    pool->data = data;
+#ifdef BAND_POOL_THREADS
+    if (pool->threads > 1)
+    {
+        /* The mutex publishes the job to the workers, and taking it
+         * again below makes their pixels visible to the caller. */
+        pthread_mutex_lock(&pool->lock);
+        pool->pending = pool->threads - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    job(data, 0);
+    if (pool->threads > 1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending > 0)
+            pthread_cond_wait(&pool->finished, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    }
+#else
+    for (int b = 0; b < pool->threads; b++)
+        job(data, b);
+#endif
+}
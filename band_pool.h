@@ -0,0 +1,38 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * A persistent pool of worker threads that runs one job over a fixed
+ * number of bands, one band per thread. The caller is thread 0 and
+ * draws band 0 itself; band_pool_run() returns once every band is
+ * done, so each call is a barrier and the job never outlives it.
+ *
+ * Without threads (an emscripten build without -pthread) the pool has
+ * a single thread and runs every band in turn on the caller.
+ */
+#ifndef SNEK_BAND_POOL_H
+#define SNEK_BAND_POOL_H
+
+typedef struct band_pool band_pool_t;
+
+typedef void (*band_job_t)(void *data, int band);
+
+/* Start a pool of threads, including the caller's; 0 uses one per
+ * online CPU. Returns NULL on failure. */
+band_pool_t *band_pool_create(int threads);
+void band_pool_destroy(band_pool_t *pool);
+
+/* Threads actually running, which may be fewer than asked for. */
+int band_pool_threads(const band_pool_t *pool);
+
+/* Run job(data, band) for every band below band_pool_threads(). */
+void band_pool_run(band_pool_t *pool, band_job_t job, void *data);
+
+#endif
@@ -0,0 +1,691 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Benchmark host for the Snek core, built and run by `make bench`.
+ *
+ * Links the core directly, stubs out the frontend and drives
+ * retro_run() through a fixed set of scenarios with seeded input, so
+ * that two builds can be compared run against run. Only retro_run() is
+ * timed; the bench may look at the game between frames through a save
+ * state (to steer, or to detect game over) without that showing up in
+ * the numbers.
+ *
+ * Scenarios that need a particular board (a snake filling most of it,
+ * a pool full of particles) are set up by editing a save state, so the
+ * layout below must follow the core's; the bench refuses to run
+ * against another state version. Built with PROFILE=1, the core's own
+ * per-stage profile is printed after each scenario.
+ *
+ * usage: snek_bench [-n frames] [-seed n] [-movie dir] [key=value ...]
+ * Core options given as key=value apply to every scenario. -movie
+ * adds a scenario replaying the snek.movie recorded in dir.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "libretro.h"
+#include "pixel_ops.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Save state layout, see "Save states" in snake_core.c. */
+#define ST_VERSION 10
+#define ST_OFF_VERSION 4
+#define ST_OFF_STATE 8
+#define ST_OFF_DIR 9
+#define ST_OFF_PENDING_DIR 10
+#define ST_OFF_ITEM 11
+#define ST_OFF_FOOD_X 13
+#define ST_OFF_FOOD_Y 15
+#define ST_OFF_LENGTH 21
+#define ST_OFF_OBSTACLE_COUNT 23
+#define ST_OFF_PHASE 25
+#define ST_OFF_SCORE 37
+#define ST_OFF_RNG 53
+#define ST_OFF_FX_RNG 61
+#define ST_OFF_GRID_W 69
+#define ST_OFF_GRID_H 71
+#define ST_OFF_OBSTACLES 110
+#define ST_PARTICLE_SIZE 24
+
+/* Game states and directions as stored in the state. */
+enum { GAME_TITLE, GAME_PLAY, GAME_PAUSE, GAME_OVER };
+enum { DIR_UP, DIR_DOWN, DIR_LEFT, DIR_RIGHT };
+
+#define MAX_OPTIONS 16
+
+typedef struct
+{
+    const char *key, *value;
+} option_t;
+
+static option_t options[MAX_OPTIONS];
+static int option_count;
+static option_t scenario_options[4];
+static int scenario_option_count;
+
+static unsigned input_mask;
+static char profile_log[4096];
+static size_t profile_len;
+
+static uint8_t *state_buf;
+static size_t state_size;
+
+/* Where snek.movie is read from, or NULL. */
+static const char *movie_dir;
+
+/* Answer to GET_AUDIO_VIDEO_ENABLE, or -1 to not support it. */
+static int av_enable = -1;
+
+/* ------------------------------------------------------------------
+ * Frontend stubs
+ */
+static void bench_log(enum retro_log_level level, const char *fmt, ...)
+{
+    (void)level;
+    /* Keep the most recent profile block. */
+    if (strncmp(fmt, "[snek] frame times", 18) == 0)
+        profile_len = 0;
+    else if (strncmp(fmt, "[snek]", 6) != 0)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(profile_log + profile_len, sizeof(profile_log) - profile_len, fmt, ap);
+    va_end(ap);
+    if (n > 0 && profile_len + (size_t)n < sizeof(profile_log))
+        profile_len += (size_t)n;
+}
+
+static const char *option_value(const char *key)
+{
+    for (int i = 0; i < scenario_option_count; i++)
+        if (strcmp(scenario_options[i].key, key) == 0)
+            return scenario_options[i].value;
+    for (int i = 0; i < option_count; i++)
+        if (strcmp(options[i].key, key) == 0)
+            return options[i].value;
+    return NULL;
+}
+
+static bool environment(unsigned cmd, void *data)
+{
+    switch (cmd)
+    {
+    case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+        ((struct retro_log_callback *)data)->log = bench_log;
+        return true;
+    case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+        *(const char **)data = movie_dir;
+        return movie_dir != NULL;
+    case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+        *(bool *)data = true;
+        return true;
+    case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+    case RETRO_ENVIRONMENT_SET_GEOMETRY:
+    case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO:
+        return true;
+    case RETRO_ENVIRONMENT_GET_VARIABLE:
+    {
+        struct retro_variable *var = (struct retro_variable *)data;
+        var->value = option_value(var->key);
+        return var->value != NULL;
+    }
+    case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
+        *(bool *)data = false;
+        return true;
+    case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+        if (av_enable < 0)
+            return false;
+        if (data)
+            *(int *)data = av_enable;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void video_refresh(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+    (void)data;
+    (void)width;
+    (void)height;
+    (void)pitch;
+}
+
+static void audio_sample(int16_t left, int16_t right)
+{
+    (void)left;
+    (void)right;
+}
+
+static size_t audio_sample_batch(const int16_t *data, size_t frames)
+{
+    (void)data;
+    return frames;
+}
+
+static void input_poll(void) {}
+
+static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+    (void)device;
+    (void)index;
+    return port == 0 && id < 16 ? (int16_t)((input_mask >> id) & 1) : 0;
+}
+
+/* ------------------------------------------------------------------
+ * Seeded randomness and save state access
+ */
+static uint64_t bench_rng;
+
+static uint32_t rnd(void)
+{
+    bench_rng = bench_rng * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(bench_rng >> 33);
+}
+
+static uint16_t rd16(size_t off)
+{
+    uint16_t v;
+    memcpy(&v, state_buf + off, sizeof(v));
+    return v;
+}
+
+static void wr16(size_t off, uint16_t v) { memcpy(state_buf + off, &v, sizeof(v)); }
+static void wr32(size_t off, uint32_t v) { memcpy(state_buf + off, &v, sizeof(v)); }
+static void wr64(size_t off, uint64_t v) { memcpy(state_buf + off, &v, sizeof(v)); }
+
+static bool state_read(void)
+{
+    state_size = retro_serialize_size();
+    free(state_buf);
+    state_buf = (uint8_t *)calloc(1, state_size);
+    return state_buf && retro_serialize(state_buf, state_size) && rd16(ST_OFF_VERSION) == ST_VERSION;
+}
+
+static bool state_write(void)
+{
+    return retro_unserialize(state_buf, state_size);
+}
+
+static int grid_w(void) { return rd16(ST_OFF_GRID_W); }
+static int grid_h(void) { return rd16(ST_OFF_GRID_H); }
+static size_t obstacles_size(void) { return (size_t)(grid_w() * grid_h() + 31) / 32 * 4; }
+static size_t body_offset(void) { return ST_OFF_OBSTACLES + obstacles_size(); }
+
+static bool obstacle_at(int x, int y)
+{
+    int idx = y * grid_w() + x;
+    uint32_t word;
+    memcpy(&word, state_buf + ST_OFF_OBSTACLES + (size_t)(idx / 32) * 4, sizeof(word));
+    return (word >> (idx % 32)) & 1;
+}
+
+/* ------------------------------------------------------------------
+ * Input scripts, one call per frame before retro_run()
+ */
+static int script_frame;
+
+static unsigned joypad(unsigned id) { return 1u << id; }
+
+static unsigned dir_button(int dir)
+{
+    static const unsigned buttons[] = {RETRO_DEVICE_ID_JOYPAD_UP, RETRO_DEVICE_ID_JOYPAD_DOWN,
+                                       RETRO_DEVICE_ID_JOYPAD_LEFT, RETRO_DEVICE_ID_JOYPAD_RIGHT};
+    return joypad(buttons[dir]);
+}
+
+/* Press Start on the first frame. */
+static unsigned script_start(void)
+{
+    return script_frame == 0 ? joypad(RETRO_DEVICE_ID_JOYPAD_START) : 0;
+}
+
+static unsigned script_idle(void) { return 0; }
+
+/* Head for the food, avoiding walls and the body, and start over
+ * after a crash. */
+static unsigned script_greedy(void)
+{
+    if (script_frame == 0 || !state_read())
+        return script_start();
+    if (state_buf[ST_OFF_STATE] == GAME_OVER)
+        return (script_frame & 1) ? joypad(RETRO_DEVICE_ID_JOYPAD_START) : 0;
+    int w = grid_w(), h = grid_h();
+    int length = rd16(ST_OFF_LENGTH);
+    int head = rd16(body_offset());
+    int hx = head % w, hy = head / w;
+    int fx = (int16_t)rd16(ST_OFF_FOOD_X), fy = (int16_t)rd16(ST_OFF_FOOD_Y);
+    int dir = state_buf[ST_OFF_DIR];
+    static const int dx[] = {0, 0, -1, 1}, dy[] = {-1, 1, 0, 0};
+    int best = -1, best_dist = 0;
+    for (int d = 0; d < 4; d++)
+    {
+        if ((d ^ 1) == dir)
+            continue;
+        int x = hx + dx[d], y = hy + dy[d];
+        if (x < 0 || x >= w || y < 0 || y >= h || obstacle_at(x, y))
+            continue;
+        bool body = false;
+        for (int i = 1; i < length - 1 && !body; i++)
+            body = rd16(body_offset() + 2 * (size_t)i) == y * w + x;
+        if (body)
+            continue;
+        int dist = abs(fx - x) + abs(fy - y) + (int)(rnd() % 2);
+        if (best < 0 || dist < best_dist)
+        {
+            best = d;
+            best_dist = dist;
+        }
+    }
+    return best >= 0 ? dir_button(best) : 0;
+}
+
+/* Change direction every few moves. */
+static unsigned script_wander(void)
+{
+    static int dir, hold;
+    if (hold-- <= 0)
+    {
+        dir = (int)(rnd() % 4);
+        hold = 8 + (int)(rnd() % 40);
+    }
+    return dir_button(dir);
+}
+
+/* Start, then pause on the second frame. */
+static unsigned script_pause(void)
+{
+    return script_frame == 0 || script_frame == 2 ? joypad(RETRO_DEVICE_ID_JOYPAD_START) : 0;
+}
+
+/* Start and run straight into the wall. */
+static unsigned script_crash(void)
+{
+    return script_frame == 0 ? joypad(RETRO_DEVICE_ID_JOYPAD_START) : dir_button(DIR_UP);
+}
+
+/* ------------------------------------------------------------------
+ * Prepared boards
+ */
+
+/* A snake covering nine tenths of an empty board that phases forever,
+ * so it can wander without crashing. Cells are laid out as a
+ * serpentine so neighbouring segments touch. */
+static bool setup_long_snake(void)
+{
+    if (!state_read())
+        return false;
+    int w = grid_w(), h = grid_h();
+    int cells = w * h;
+    int length = cells * 9 / 10;
+    memset(state_buf + ST_OFF_OBSTACLES, 0, obstacles_size());
+    wr16(ST_OFF_OBSTACLE_COUNT, 0);
+    wr32(ST_OFF_PHASE, 0x3FFFFFFF);
+    wr32(ST_OFF_SCORE, (uint32_t)(10 * (length - 3)));
+    /* Serpentine position p, head at p = length - 1. */
+#define SERPENTINE(p) ((p) / w * w + (((p) / w) % 2 ? w - 1 - (p) % w : (p) % w))
+    size_t body = body_offset();
+    for (int i = 0; i < length; i++)
+        wr16(body + 2 * (size_t)i, (uint16_t)SERPENTINE(length - 1 - i));
+    int food = SERPENTINE(length + 5 < cells ? length + 5 : cells - 1);
+#undef SERPENTINE
+    int dir = ((length - 1) / w) % 2 ? DIR_LEFT : DIR_RIGHT;
+    state_buf[ST_OFF_DIR] = state_buf[ST_OFF_PENDING_DIR] = (uint8_t)dir;
+    state_buf[ST_OFF_ITEM] = 0;
+    wr16(ST_OFF_LENGTH, (uint16_t)length);
+    wr16(ST_OFF_FOOD_X, (uint16_t)(food % w));
+    wr16(ST_OFF_FOOD_Y, (uint16_t)(food / w));
+    /* The particle count follows the body; none are live. */
+    wr16(body + 2 * (size_t)length, 0);
+    return state_write();
+}
+
+/* The state the storm restarts from. */
+static uint8_t *storm_state;
+
+/* Fill the particle pool with sparks all over the board. The pool
+ * drains within a second, so the board is reloaded every
+ * STORM_PERIOD frames. */
+#define STORM_PERIOD 50
+
+static bool setup_storm(void)
+{
+    if (!state_read())
+        return false;
+    int length = rd16(ST_OFF_LENGTH);
+    size_t count_at = body_offset() + 2 * (size_t)length;
+    size_t room = (state_size - count_at - 2) / ST_PARTICLE_SIZE;
+    const char *pool = option_value("snek_particles");
+    size_t capacity = pool ? (size_t)atoi(pool) : 128;
+    if (room > capacity)
+        room = capacity;
+    int w = grid_w(), h = grid_h();
+    int cell = 16;
+    const char *cell_opt = option_value("snek_cell_size");
+    if (cell_opt)
+        cell = atoi(cell_opt);
+    wr16(count_at, (uint16_t)room);
+    for (size_t i = 0; i < room; i++)
+    {
+        size_t p = count_at + 2 + i * ST_PARTICLE_SIZE;
+        wr32(p + 0, (uint32_t)((int32_t)(rnd() % (uint32_t)(w * cell)) << 16));
+        wr32(p + 4, (uint32_t)((int32_t)(rnd() % (uint32_t)(h * cell)) << 16));
+        wr32(p + 8, (uint32_t)((int32_t)(rnd() % 262144) - 131072));
+        wr32(p + 12, (uint32_t)((int32_t)(rnd() % 262144) - 131072));
+        wr32(p + 16, 30 + rnd() % 30);
+        wr32(p + 20, 0xC85050);
+    }
+    free(storm_state);
+    storm_state = (uint8_t *)malloc(state_size);
+    if (!storm_state)
+        return false;
+    memcpy(storm_state, state_buf, state_size);
+    return state_write();
+}
+
+static unsigned script_storm(void)
+{
+    if (script_frame > 0 && script_frame % STORM_PERIOD == 0)
+        retro_unserialize(storm_state, state_size);
+    return 0;
+}
+
+/* ------------------------------------------------------------------
+ * Scenarios
+ */
+typedef struct
+{
+    const char *name;
+    /* Board preparation after Start was pressed, or NULL. */
+    bool (*setup)(void);
+    unsigned (*script)(void);
+    option_t options[2];
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    {"title idle", NULL, script_idle, {{NULL, NULL}}},
+    {"early game", NULL, script_greedy, {{NULL, NULL}}},
+    {"long snake", setup_long_snake, script_wander, {{NULL, NULL}}},
+    {"pause", NULL, script_pause, {{NULL, NULL}}},
+    {"game over", NULL, script_crash, {{NULL, NULL}}},
+    {"particle storm", setup_storm, script_storm, {{"snek_particles", "8192"}, {NULL, NULL}}},
+    /* Only with -movie; the movie supplies the input. */
+    {"movie replay", NULL, script_idle, {{"snek_movie", "play"}, {NULL, NULL}}},
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Start the core with the scenario's options and the bench seed. */
+static bool core_start(const scenario_t *sc, uint64_t seed)
+{
+    scenario_option_count = 0;
+    for (int i = 0; i < 2 && sc->options[i].key; i++)
+        scenario_options[scenario_option_count++] = sc->options[i];
+    retro_set_environment(environment);
+    retro_set_video_refresh(video_refresh);
+    retro_set_audio_sample(audio_sample);
+    retro_set_audio_sample_batch(audio_sample_batch);
+    retro_set_input_poll(input_poll);
+    retro_set_input_state(input_state);
+    retro_init();
+    if (!retro_load_game(NULL))
+        return false;
+    /* A movie brings its own state. */
+    if (sc->options[0].key && strcmp(sc->options[0].key, "snek_movie") == 0)
+        return true;
+    /* The core seeds itself from the clock. */
+    if (!state_read())
+        return false;
+    wr64(ST_OFF_RNG, seed);
+    wr64(ST_OFF_FX_RNG, ~seed);
+    return state_write();
+}
+
+static void run_scenario(const scenario_t *sc, int frames, uint64_t seed, double *times)
+{
+    bench_rng = seed;
+    profile_len = 0;
+    if (!core_start(sc, seed))
+    {
+        printf("%-16s could not start the core (state version %u, expected %u)\n", sc->name,
+               state_buf ? rd16(ST_OFF_VERSION) : 0, ST_VERSION);
+        retro_deinit();
+        return;
+    }
+    if (sc->setup)
+    {
+        input_mask = joypad(RETRO_DEVICE_ID_JOYPAD_START);
+        retro_run();
+        input_mask = 0;
+        retro_run();
+        if (!sc->setup())
+        {
+            printf("%-16s setup failed\n", sc->name);
+            retro_deinit();
+            return;
+        }
+    }
+    for (script_frame = 0; script_frame < frames; script_frame++)
+    {
+        input_mask = sc->script();
+        double t0 = now_ns();
+        retro_run();
+        times[script_frame] = now_ns() - t0;
+    }
+
+    double sum = 0;
+    for (int i = 0; i < frames; i++)
+        sum += times[i];
+    qsort(times, (size_t)frames, sizeof(double), compare_double);
+    double avg = sum / frames;
+    printf("%-16s %9.0f %9.0f %9.0f %9.0f %10.0f\n", sc->name, avg, times[0], times[frames / 2],
+           times[(frames * 99) / 100], 1e9 / avg);
+    if (profile_len)
+        fputs(profile_log, stdout);
+    retro_deinit();
+}
+
+/* Frames a rollback goes back, as for netplay across regions. */
+#define ROLLBACK_FRAMES 8
+
+/* The current board round-tripped through a save state, on the long
+ * snake board where the state is largest. Then rollback the way
+ * netplay does it: a state every frame, and every ROLLBACK_FRAMES
+ * frames back to the oldest one and forward again, with only the last
+ * frame shown. The states never leave the process, so they are taken
+ * as fast savestates. */
+static void run_serialize(uint64_t seed)
+{
+    const scenario_t *sc = &scenarios[2];
+    const int rounds = 2000;
+    if (!core_start(sc, seed))
+    {
+        retro_deinit();
+        return;
+    }
+    input_mask = joypad(RETRO_DEVICE_ID_JOYPAD_START);
+    retro_run();
+    input_mask = 0;
+    if (!sc->setup())
+    {
+        retro_deinit();
+        return;
+    }
+    size_t size = retro_serialize_size();
+    void *buf = malloc(size);
+    double t0 = now_ns();
+    for (int i = 0; i < rounds; i++)
+        retro_serialize(buf, size);
+    double t1 = now_ns();
+    for (int i = 0; i < rounds; i++)
+        retro_unserialize(buf, size);
+    double t2 = now_ns();
+    printf("\nsave state %zu bytes: serialize %.0f ns, unserialize %.0f ns\n", size,
+           (t1 - t0) / rounds, (t2 - t1) / rounds);
+    free(buf);
+
+    uint8_t *ring = (uint8_t *)malloc(size * ROLLBACK_FRAMES);
+    if (!ring)
+    {
+        retro_deinit();
+        return;
+    }
+    const int rollbacks = 200;
+    const int shown = RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO | RETRO_AV_ENABLE_FAST_SAVESTATES;
+    double spent = 0;
+    script_frame = 0;
+    for (int r = 0; r < rollbacks; r++)
+    {
+        av_enable = shown;
+        for (int k = 0; k < ROLLBACK_FRAMES; k++)
+        {
+            retro_serialize(ring + k * size, size);
+            input_mask = sc->script();
+            retro_run();
+            script_frame++;
+        }
+        double t = now_ns();
+        retro_unserialize(ring, size);
+        script_frame -= ROLLBACK_FRAMES;
+        for (int k = 0; k < ROLLBACK_FRAMES; k++)
+        {
+            av_enable = k == ROLLBACK_FRAMES - 1 ? shown : RETRO_AV_ENABLE_FAST_SAVESTATES;
+            retro_serialize(ring + k * size, size);
+            input_mask = sc->script();
+            retro_run();
+            script_frame++;
+        }
+        spent += now_ns() - t;
+    }
+    av_enable = -1;
+    printf("rollback of %d frames: %.0f ns\n", ROLLBACK_FRAMES, spent / rollbacks);
+    free(ring);
+    retro_deinit();
+}
+
+/* The array kernels of pixel_ops.c on one row of a 1080p frame, plus
+ * one pixel so the scalar tail runs too. Each is checked against its
+ * single pixel helper first, so a broken vector path fails here rather
+ * than only showing as slightly different colours. */
+#define PX_ROW_PIXELS 1921
+
+static bool check_pixels(const char *name, const uint32_t *got, const uint32_t *want)
+{
+    for (int i = 0; i < PX_ROW_PIXELS; i++)
+        if (got[i] != want[i])
+        {
+            printf("%s: pixel %d is %08x, expected %08x\n", name, i, (unsigned)got[i], (unsigned)want[i]);
+            return false;
+        }
+    return true;
+}
+
+static void run_pixel_ops(uint64_t seed)
+{
+    static uint32_t src[PX_ROW_PIXELS], dst[PX_ROW_PIXELS], want[PX_ROW_PIXELS];
+    const int rounds = 20000;
+    const uint32_t factor = PX_FACTOR(2, 5), colour = 0x00204060u, t = 96, add = 0x00303030u;
+    bench_rng = seed;
+    for (int i = 0; i < PX_ROW_PIXELS; i++)
+        src[i] = (rnd() << 16) ^ rnd();
+
+    for (int i = 0; i < PX_ROW_PIXELS; i++)
+        want[i] = px_scale1(src[i], factor);
+    px_scale(dst, src, PX_ROW_PIXELS, factor);
+    bool ok = check_pixels("px_scale", dst, want);
+    for (int i = 0; i < PX_ROW_PIXELS; i++)
+        want[i] = px_lerp1(src[i], colour, t);
+    px_lerp(dst, src, PX_ROW_PIXELS, colour, t);
+    ok &= check_pixels("px_lerp", dst, want);
+    for (int i = 0; i < PX_ROW_PIXELS; i++)
+        want[i] = px_adds1(src[i], add);
+    px_adds(dst, src, PX_ROW_PIXELS, add);
+    ok &= check_pixels("px_adds", dst, want);
+    if (!ok)
+        return;
+
+    double t0 = now_ns();
+    for (int i = 0; i < rounds; i++)
+        px_scale(dst, src, PX_ROW_PIXELS, factor);
+    double t1 = now_ns();
+    for (int i = 0; i < rounds; i++)
+        px_lerp(dst, src, PX_ROW_PIXELS, colour, t);
+    double t2 = now_ns();
+    for (int i = 0; i < rounds; i++)
+        px_adds(dst, src, PX_ROW_PIXELS, add);
+    double t3 = now_ns();
+    printf("pixel ops on %d pixels: scale %.0f ns, lerp %.0f ns, adds %.0f ns\n", PX_ROW_PIXELS,
+           (t1 - t0) / rounds, (t2 - t1) / rounds, (t3 - t2) / rounds);
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 3600;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-movie") == 0 && i + 1 < argc)
+            movie_dir = argv[++i];
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (strchr(argv[i], '=') && option_count < MAX_OPTIONS)
+        {
+            char *eq = strchr(argv[i], '=');
+            *eq = '\0';
+            options[option_count].key = argv[i];
+            options[option_count++].value = eq + 1;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-n frames] [-seed n] [-movie dir] [key=value ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (frames < 1)
+        frames = 1;
+    double *times = (double *)malloc((size_t)frames * sizeof(double));
+    if (!times)
+        return 1;
+
+    printf("%d frames per scenario, seed %llu\n\n", frames, (unsigned long long)seed);
+    printf("%-16s %9s %9s %9s %9s %10s\n", "scenario", "avg ns", "min ns", "p50 ns", "p99 ns", "frames/s");
+    size_t count = sizeof(scenarios) / sizeof(scenarios[0]);
+    if (!movie_dir)
+        count--;
+    for (size_t i = 0; i < count; i++)
+        run_scenario(&scenarios[i], frames, seed, times);
+    run_serialize(seed);
+    run_pixel_ops(seed);
+
+    free(times);
+    free(state_buf);
+    free(storm_state);
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+#include "blit.h"
+#include "pixel_ops.h"
+
+#include <string.h>
+
+void surface_init(surface_t *s, void *pixels, surface_format_t format, int width, int height, int stride)
+{
+    s->pixels = pixels;
+    s->format = format;
+    s->bytes_per_pixel = surface_format_bytes(format);
+    s->width = width;
+    s->height = height;
+    s->stride = stride;
+    s->clip_x0 = 0;
+    s->clip_y0 = 0;
+    s->clip_x1 = width;
+    s->clip_y1 = height;
+}
+
+void surface_set_clip(surface_t *s, int x, int y, int w, int h)
+{
+    s->clip_x0 = x < 0 ? 0 : x;
+    s->clip_y0 = y < 0 ? 0 : y;
+    s->clip_x1 = x + w > s->width ? s->width : x + w;
+    s->clip_y1 = y + h > s->height ? s->height : y + h;
+    if (s->clip_x1 < s->clip_x0)
+        s->clip_x1 = s->clip_x0;
+    if (s->clip_y1 < s->clip_y0)
+        s->clip_y1 = s->clip_y0;
+}
+
+/* Clip [*x, *x + *w) × [*y, *y + *h) to the clip rectangle. Returns
+ * false when nothing is left; *dx and *dy receive how far the top left
+ * corner moved. */
+static int clip_rect(const surface_t *s, int *x, int *y, int *w, int *h, int *dx, int *dy)
+{
+    int x0 = *x, y0 = *y, x1 = *x + *w, y1 = *y + *h;
+    if (x0 < s->clip_x0)
+        x0 = s->clip_x0;
+    if (y0 < s->clip_y0)
+        y0 = s->clip_y0;
+    if (x1 > s->clip_x1)
+        x1 = s->clip_x1;
+    if (y1 > s->clip_y1)
+        y1 = s->clip_y1;
+    if (x0 >= x1 || y0 >= y1)
+        return 0;
+    *dx = x0 - *x;
+    *dy = y0 - *y;
+    *x = x0;
+    *y = y0;
+    *w = x1 - x0;
+    *h = y1 - y0;
+    return 1;
+}
+
+/* The per‑format loops are generated from one body each. */
+#define DEFINE_FILL(name, pixel_t)                                                   \
+    static void name(const surface_t *s, int x, int y, int w, int h, uint32_t colour) \
+    {                                                                                 \
+        for (int row = 0; row < h; row++)                                             \
+        {                                                                             \
+            pixel_t *dst = (pixel_t *)surface_pixel(s, x, y + row);                   \
+            for (int i = 0; i < w; i++)                                               \
+                dst[i] = (pixel_t)colour;                                             \
+        }                                                                             \
+    }
+
+#define DEFINE_MASKED(name, pixel_t)                                                          \
+    static void name(const surface_t *s, int x, int y, const uint32_t *rows, int dx, int w, \
+                     int h, uint32_t colour)                                                 \
+    {                                                                                        \
+        const pixel_t c = (pixel_t)colour;                                                   \
+        for (int row = 0; row < h; row++)                                                    \
+        {                                                                                    \
+            pixel_t *dst = (pixel_t *)surface_pixel(s, x, y + row);                          \
+            uint32_t bits = rows[row] >> dx;                                                 \
+            for (int i = 0; i < w; i++)                                                      \
+            {                                                                                \
+                pixel_t m = (pixel_t)(0u - ((bits >> i) & 1u));                              \
+                dst[i] = (pixel_t)((dst[i] & (pixel_t)~m) | (c & m));                        \
+            }                                                                                \
+        }                                                                                    \
+    }
+
+DEFINE_FILL(fill32, uint32_t)
+DEFINE_FILL(fill16, uint16_t)
+DEFINE_MASKED(masked32, uint32_t)
+DEFINE_MASKED(masked16, uint16_t)
+
+void blit_fill_rect(const surface_t *s, int x, int y, int w, int h, uint32_t colour)
+{
+    int dx, dy;
+    if (!clip_rect(s, &x, &y, &w, &h, &dx, &dy))
+        return;
+    if (s->format == SURFACE_RGB565)
+        fill16(s, x, y, w, h, colour);
+    else
+        fill32(s, x, y, w, h, colour);
+}
+
+void blit_plot_run(const surface_t *s, int x, int y, int len, uint32_t colour)
+{
+    blit_fill_rect(s, x, y, len, 1, colour);
+}
+
+void blit_sprite(const surface_t *s, int x, int y, const void *src, int w, int h, int src_stride)
+{
+    int dx, dy;
+    if (!clip_rect(s, &x, &y, &w, &h, &dx, &dy))
+        return;
+    size_t bpp = (size_t)s->bytes_per_pixel;
+    const uint8_t *from = (const uint8_t *)src + ((ptrdiff_t)dy * src_stride + dx) * bpp;
+    /* Full width copies between same-layout buffers are one block. */
+    if (w == s->stride && w == src_stride)
+    {
+        memcpy(surface_pixel(s, x, y), from, (size_t)w * (size_t)h * bpp);
+        return;
+    }
+    for (int row = 0; row < h; row++, from += (size_t)src_stride * bpp)
+        memcpy(surface_pixel(s, x, y + row), from, (size_t)w * bpp);
+}
+
+void blit_masked(const surface_t *s, int x, int y, const uint32_t *rows, int w, int h, uint32_t colour)
+{
+    int dx, dy;
+    if (!clip_rect(s, &x, &y, &w, &h, &dx, &dy))
+        return;
+    if (s->format == SURFACE_RGB565)
+        masked16(s, x, y, rows + dy, dx, w, h, colour);
+    else
+        masked32(s, x, y, rows + dy, dx, w, h, colour);
+}
+
+static void scale_span(const surface_t *s, void *p, size_t count, uint32_t factor)
+{
+    if (s->format == SURFACE_RGB565)
+        px_scale565((uint16_t *)p, (const uint16_t *)p, count, factor);
+    else
+        px_scale((uint32_t *)p, (const uint32_t *)p, count, factor);
+}
+
+void blit_scale(const surface_t *s, uint32_t factor)
+{
+    int w = s->clip_x1 - s->clip_x0;
+    int h = s->clip_y1 - s->clip_y0;
+    if (w <= 0 || h <= 0)
+        return;
+    /* One call when the clip rectangle is a contiguous span. */
+    if (w == s->stride)
+    {
+        scale_span(s, surface_pixel(s, 0, s->clip_y0), (size_t)w * (size_t)h, factor);
+        return;
+    }
+    for (int y = s->clip_y0; y < s->clip_y1; y++)
+        scale_span(s, surface_pixel(s, s->clip_x0, y), (size_t)w, factor);
+}
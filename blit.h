@@ -0,0 +1,104 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Clipped blitter primitives on 32 bit (XRGB8888) and 16 bit (RGB565)
+ * surfaces.
+ *
+ * Every primitive clips its rectangle against the surface's clip
+ * rectangle once and picks the loop for the surface's format, so the
+ * inner loops are branch‑free and callers never need per‑pixel bounds
+ * checks. Colours passed to the primitives are in the surface's own
+ * format; surface_colour() converts from XRGB8888.
+ */
+#ifndef SNEK_BLIT_H
+#define SNEK_BLIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    SURFACE_XRGB8888,
+    SURFACE_RGB565
+} surface_format_t;
+
+/* A view of a pixel buffer. stride is in pixels. Drawing is limited to
+ * the clip rectangle [clip_x0, clip_x1) × [clip_y0, clip_y1), which is
+ * always inside the surface. */
+typedef struct
+{
+    void *pixels;
+    surface_format_t format;
+    int bytes_per_pixel;
+    int width, height;
+    int stride;
+    int clip_x0, clip_y0, clip_x1, clip_y1;
+} surface_t;
+
+static inline int surface_format_bytes(surface_format_t format)
+{
+    return format == SURFACE_RGB565 ? 2 : 4;
+}
+
+/* Truncating XRGB8888 to RGB565 conversion. */
+static inline uint16_t rgb565_from_xrgb(uint32_t c)
+{
+    return (uint16_t)(((c >> 8) & 0xF800u) | ((c >> 5) & 0x07E0u) | ((c >> 3) & 0x001Fu));
+}
+
+/* An XRGB8888 colour in the given format. */
+static inline uint32_t surface_colour(surface_format_t format, uint32_t xrgb)
+{
+    return format == SURFACE_RGB565 ? rgb565_from_xrgb(xrgb) : xrgb;
+}
+
+/* Set up a surface over pixels, clipping to the whole buffer. */
+void surface_init(surface_t *s, void *pixels, surface_format_t format, int width, int height, int stride);
+
+/* Restrict drawing to a rectangle (intersected with the surface). */
+void surface_set_clip(surface_t *s, int x, int y, int w, int h);
+
+/* Address of pixel (x, y). */
+static inline uint8_t *surface_pixel(const surface_t *s, int x, int y)
+{
+    return (uint8_t *)s->pixels + ((ptrdiff_t)y * s->stride + x) * s->bytes_per_pixel;
+}
+
+/* Set a single pixel if it lies inside the clip rectangle. */
+static inline void blit_plot(const surface_t *s, int x, int y, uint32_t colour)
+{
+    if (x < s->clip_x0 || x >= s->clip_x1 || y < s->clip_y0 || y >= s->clip_y1)
+        return;
+    if (s->format == SURFACE_RGB565)
+        *(uint16_t *)surface_pixel(s, x, y) = (uint16_t)colour;
+    else
+        *(uint32_t *)surface_pixel(s, x, y) = colour;
+}
+
+/* Fill a w×h rectangle with a colour. */
+void blit_fill_rect(const surface_t *s, int x, int y, int w, int h, uint32_t colour);
+
+/* Fill a horizontal run of len pixels starting at (x, y). */
+void blit_plot_run(const surface_t *s, int x, int y, int len, uint32_t colour);
+
+/* Copy a w×h block of pixels in the surface's format to (x, y). src
+ * points at the block's top left pixel; src_stride is in pixels. */
+void blit_sprite(const surface_t *s, int x, int y, const void *src, int w, int h, int src_stride);
+
+/* Draw colour wherever a bit is set in a 1 bit mask. Each row is one
+ * word with the leftmost column in bit 0, so w is at most 32. */
+void blit_masked(const surface_t *s, int x, int y, const uint32_t *rows, int w, int h, uint32_t colour);
+
+/* Scale every channel inside the clip rectangle by factor (0.16 fixed
+ * point, see pixel_ops.h). */
+void blit_scale(const surface_t *s, uint32_t factor);
+
+#endif
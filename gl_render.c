@@ -0,0 +1,415 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * OpenGL renderer. See gl_render.h.
+ */
+#include "gl_render.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#if defined(HAVE_OPENGLES)
+#include <GLES2/gl2.h>
+#define GL_CALL GL_APIENTRY
+#elif defined(__APPLE__)
+#include <OpenGL/gl.h>
+#define GL_CALL
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#define GL_CALL APIENTRY
+#endif
+
+/* Desktop gl.h only declares OpenGL 1.1; these come from 1.3 to 2.0. */
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_STREAM_DRAW 0x88E0
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#endif
+#ifndef GL_TEXTURE0
+#define GL_TEXTURE0 0x84C0
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#endif
+
+/* The GL functions used, looked up by gl_render_init(). */
+#define GL_FUNCTIONS(X)                                                                        \
+    X(void, ActiveTexture, (GLenum texture))                                                   \
+    X(void, AttachShader, (GLuint program, GLuint shader))                                     \
+    X(void, BindAttribLocation, (GLuint program, GLuint index, const char *name))              \
+    X(void, BindBuffer, (GLenum target, GLuint buffer))                                        \
+    X(void, BindFramebuffer, (GLenum target, GLuint framebuffer))                              \
+    X(void, BindTexture, (GLenum target, GLuint texture))                                      \
+    X(void, BlendFunc, (GLenum sfactor, GLenum dfactor))                                       \
+    X(void, BufferData, (GLenum target, ptrdiff_t size, const void *data, GLenum usage))       \
+    X(void, CompileShader, (GLuint shader))                                                    \
+    X(GLuint, CreateProgram, (void))                                                           \
+    X(GLuint, CreateShader, (GLenum type))                                                     \
+    X(void, DeleteBuffers, (GLsizei n, const GLuint *buffers))                                 \
+    X(void, DeleteProgram, (GLuint program))                                                   \
+    X(void, DeleteShader, (GLuint shader))                                                     \
+    X(void, DeleteTextures, (GLsizei n, const GLuint *textures))                               \
+    X(void, Disable, (GLenum cap))                                                             \
+    X(void, DrawArrays, (GLenum mode, GLint first, GLsizei count))                             \
+    X(void, Enable, (GLenum cap))                                                              \
+    X(void, EnableVertexAttribArray, (GLuint index))                                           \
+    X(void, GenBuffers, (GLsizei n, GLuint *buffers))                                          \
+    X(void, GenTextures, (GLsizei n, GLuint *textures))                                        \
+    X(void, GetProgramiv, (GLuint program, GLenum pname, GLint *params))                       \
+    X(void, GetShaderiv, (GLuint shader, GLenum pname, GLint *params))                         \
+    X(GLint, GetUniformLocation, (GLuint program, const char *name))                           \
+    X(void, LinkProgram, (GLuint program))                                                     \
+    X(void, PixelStorei, (GLenum pname, GLint param))                                          \
+    X(void, ShaderSource, (GLuint shader, GLsizei count, const char *const *string, const GLint *length)) \
+    X(void, TexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width,      \
+                         GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels)) \
+    X(void, TexParameteri, (GLenum target, GLenum pname, GLint param))                         \
+    X(void, Uniform1i, (GLint location, GLint v0))                                             \
+    X(void, Uniform2f, (GLint location, GLfloat v0, GLfloat v1))                               \
+    X(void, UseProgram, (GLuint program))                                                      \
+    X(void, VertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, \
+                                  GLsizei stride, const void *pointer))                         \
+    X(void, Viewport, (GLint x, GLint y, GLsizei width, GLsizei height))
+
+#define GL_DECLARE(ret, name, args) ret(GL_CALL *name) args;
+static struct
+{
+    GL_FUNCTIONS(GL_DECLARE)
+} gl;
+#undef GL_DECLARE
+
+typedef struct
+{
+    float x, y, u, v;
+    uint8_t colour[4]; /* alpha 255 for sprites, 0 for shaded quads */
+} gl_vertex_t;
+
+/* Attribute locations, bound before linking. */
+enum
+{
+    ATTR_POS,
+    ATTR_UV,
+    ATTR_COLOUR
+};
+
+static const char *const vertex_source =
+    "uniform vec2 screen_size;\n"
+    "uniform vec2 texture_size;\n"
+    "attribute vec2 pos;\n"
+    "attribute vec2 uv;\n"
+    "attribute vec4 colour;\n"
+    "varying vec2 v_uv;\n"
+    "varying vec4 v_colour;\n"
+    "void main()\n"
+    "{\n"
+    "    v_uv = uv / texture_size;\n"
+    "    v_colour = colour;\n"
+    "    gl_Position = vec4(pos.x / screen_size.x * 2.0 - 1.0, 1.0 - pos.y / screen_size.y * 2.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *const fragment_source =
+    "#ifdef GL_ES\n"
+    "#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+    "precision highp float;\n"
+    "#else\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "#endif\n"
+    "uniform sampler2D atlas;\n"
+    "varying vec2 v_uv;\n"
+    "varying vec4 v_colour;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 t = texture2D(atlas, v_uv);\n"
+    "    if (v_colour.a > 0.5)\n"
+    "        gl_FragColor = vec4(t.rgb * v_colour.rgb, t.a);\n"
+    "    else\n"
+    "        gl_FragColor = vec4(t.rgb + t.a * v_colour.rgb, ceil(t.a));\n"
+    "}\n";
+
+static bool gl_ready = false;
+static GLuint program = 0;
+static GLint screen_size_uniform, texture_size_uniform;
+static GLuint vertex_buffer = 0;
+static GLuint atlas_texture = 0, background_texture = 0;
+static int atlas_w = 1, atlas_h = 1;
+static int background_w = 1, background_h = 1;
+
+/* The batch. The first quad is the background. */
+static gl_vertex_t *vertices = NULL;
+static size_t vertex_count = 0, vertex_capacity = 0;
+static uint8_t *background_rgba = NULL;
+static size_t background_capacity = 0;
+
+static GLuint compile(GLenum type, const char *source)
+{
+    GLuint shader = gl.CreateShader(type);
+    GLint ok = 0;
+    gl.ShaderSource(shader, 1, &source, NULL);
+    gl.CompileShader(shader);
+    gl.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok)
+    {
+        gl.DeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint texture_create(void)
+{
+    GLuint texture;
+    gl.GenTextures(1, &texture);
+    gl.BindTexture(GL_TEXTURE_2D, texture);
+    gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+bool gl_render_init(retro_hw_get_proc_address_t get_proc_address)
+{
+    gl_ready = false;
+#define GL_LOOKUP(ret, name, args)                                        \
+    gl.name = (ret(GL_CALL *) args)get_proc_address("gl" #name); \
+    if (!gl.name)                                                       \
+        return false;
+    GL_FUNCTIONS(GL_LOOKUP)
+#undef GL_LOOKUP
+
+    GLuint vs = compile(GL_VERTEX_SHADER, vertex_source);
+    GLuint fs = compile(GL_FRAGMENT_SHADER, fragment_source);
+    GLint ok = 0;
+    if (vs && fs)
+    {
+        program = gl.CreateProgram();
+        gl.AttachShader(program, vs);
+        gl.AttachShader(program, fs);
+        gl.BindAttribLocation(program, ATTR_POS, "pos");
+        gl.BindAttribLocation(program, ATTR_UV, "uv");
+        gl.BindAttribLocation(program, ATTR_COLOUR, "colour");
+        gl.LinkProgram(program);
+        gl.GetProgramiv(program, GL_LINK_STATUS, &ok);
+    }
+    if (vs)
+        gl.DeleteShader(vs);
+    if (fs)
+        gl.DeleteShader(fs);
+    if (!ok)
+    {
+        if (program)
+            gl.DeleteProgram(program);
+        program = 0;
+        return false;
+    }
+    gl.UseProgram(program);
+    gl.Uniform1i(gl.GetUniformLocation(program, "atlas"), 0);
+    screen_size_uniform = gl.GetUniformLocation(program, "screen_size");
+    texture_size_uniform = gl.GetUniformLocation(program, "texture_size");
+    gl.UseProgram(0);
+
+    gl.GenBuffers(1, &vertex_buffer);
+    atlas_texture = texture_create();
+    background_texture = texture_create();
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+    gl_ready = true;
+    return true;
+}
+
+void gl_render_deinit(void)
+{
+    if (gl_ready)
+    {
+        gl.DeleteTextures(1, &atlas_texture);
+        gl.DeleteTextures(1, &background_texture);
+        gl.DeleteBuffers(1, &vertex_buffer);
+        gl.DeleteProgram(program);
+    }
+    gl_ready = false;
+    program = vertex_buffer = atlas_texture = background_texture = 0;
+    free(vertices);
+    free(background_rgba);
+    vertices = NULL;
+    background_rgba = NULL;
+    vertex_count = vertex_capacity = background_capacity = 0;
+}
+
+static void texture_upload(GLuint texture, const uint8_t *rgba, int w, int h)
+{
+    gl.BindTexture(GL_TEXTURE_2D, texture);
+    gl.PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+}
+
+void gl_render_set_atlas(const uint8_t *rgba, int w, int h)
+{
+    if (!gl_ready)
+        return;
+    texture_upload(atlas_texture, rgba, w, h);
+    atlas_w = w;
+    atlas_h = h;
+}
+
+void gl_render_set_background(const uint32_t *xrgb, int w, int h, int stride)
+{
+    if (!gl_ready)
+        return;
+    size_t bytes = (size_t)w * h * 4;
+    if (bytes > background_capacity)
+    {
+        uint8_t *rgba = (uint8_t *)realloc(background_rgba, bytes);
+        if (!rgba)
+            return;
+        background_rgba = rgba;
+        background_capacity = bytes;
+    }
+    uint8_t *dst = background_rgba;
+    for (int y = 0; y < h; y++)
+    {
+        const uint32_t *row = xrgb + (size_t)y * stride;
+        for (int x = 0; x < w; x++, dst += 4)
+        {
+            dst[0] = (uint8_t)(row[x] >> 16);
+            dst[1] = (uint8_t)(row[x] >> 8);
+            dst[2] = (uint8_t)row[x];
+            dst[3] = 255;
+        }
+    }
+    texture_upload(background_texture, background_rgba, w, h);
+    background_w = w;
+    background_h = h;
+}
+
+/* Make room for n more vertices. */
+static gl_vertex_t *batch_grow(size_t n)
+{
+    if (vertex_count + n > vertex_capacity)
+    {
+        size_t capacity = vertex_capacity ? vertex_capacity * 2 : 6 * 1024;
+        while (capacity < vertex_count + n)
+            capacity *= 2;
+        gl_vertex_t *grown = (gl_vertex_t *)realloc(vertices, capacity * sizeof(gl_vertex_t));
+        if (!grown)
+            return NULL;
+        vertices = grown;
+        vertex_capacity = capacity;
+    }
+    gl_vertex_t *v = vertices + vertex_count;
+    vertex_count += n;
+    return v;
+}
+
+/* Two triangles covering the quad. */
+static void quad(gl_vertex_t *v, float x0, float y0, float x1, float y1, float u0, float v0,
+                 float u1, float v1, uint32_t colour, uint8_t alpha)
+{
+    static const int corner[6][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 0}, {1, 1}, {0, 1}};
+    for (int i = 0; i < 6; i++)
+    {
+        v[i].x = corner[i][0] ? x1 : x0;
+        v[i].y = corner[i][1] ? y1 : y0;
+        v[i].u = corner[i][0] ? u1 : u0;
+        v[i].v = corner[i][1] ? v1 : v0;
+        v[i].colour[0] = (uint8_t)(colour >> 16);
+        v[i].colour[1] = (uint8_t)(colour >> 8);
+        v[i].colour[2] = (uint8_t)colour;
+        v[i].colour[3] = alpha;
+    }
+}
+
+void gl_render_begin(void)
+{
+    vertex_count = 0;
+    /* Reserve the background quad. */
+    batch_grow(6);
+}
+
+void gl_render_sprite(int x, int y, int w, int h, int u, int v, uint32_t colour)
+{
+    gl_vertex_t *q = batch_grow(6);
+    if (q)
+        quad(q, (float)x, (float)y, (float)(x + w), (float)(y + h), (float)u, (float)v,
+             (float)(u + w), (float)(v + h), colour, 255);
+}
+
+void gl_render_shaded(int x, int y, int w, int h, int u, int v, uint32_t colour)
+{
+    gl_vertex_t *q = batch_grow(6);
+    if (q)
+        quad(q, (float)x, (float)y, (float)(x + w), (float)(y + h), (float)u, (float)v,
+             (float)(u + w), (float)(v + h), colour, 0);
+}
+
+void gl_render_fill(int x, int y, int w, int h, int u, int v, uint32_t colour)
+{
+    gl_vertex_t *q = batch_grow(6);
+    if (q)
+        quad(q, (float)x, (float)y, (float)(x + w), (float)(y + h), u + 0.5f, v + 0.5f,
+             u + 0.5f, v + 0.5f, colour, 255);
+}
+
+static void draw_range(GLuint texture, int tex_w, int tex_h, size_t first, size_t count)
+{
+    gl.BindTexture(GL_TEXTURE_2D, texture);
+    gl.Uniform2f(texture_size_uniform, (GLfloat)tex_w, (GLfloat)tex_h);
+    gl.DrawArrays(GL_TRIANGLES, (GLint)first, (GLsizei)count);
+}
+
+void gl_render_end(uintptr_t fbo, int width, int height)
+{
+    if (!gl_ready || !vertices)
+        return;
+    quad(vertices, 0.0f, 0.0f, (float)width, (float)height, 0.0f, 0.0f, (float)background_w,
+         (float)background_h, 0xFFFFFFu, 255);
+
+    gl.BindFramebuffer(GL_FRAMEBUFFER, (GLuint)fbo);
+    gl.Viewport(0, 0, width, height);
+    gl.Disable(GL_DEPTH_TEST);
+    gl.Disable(GL_SCISSOR_TEST);
+    gl.Disable(GL_CULL_FACE);
+    gl.Enable(GL_BLEND);
+    gl.BlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    gl.UseProgram(program);
+    gl.Uniform2f(screen_size_uniform, (GLfloat)width, (GLfloat)height);
+    gl.ActiveTexture(GL_TEXTURE0);
+
+    gl.BindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    gl.BufferData(GL_ARRAY_BUFFER, (ptrdiff_t)(vertex_count * sizeof(gl_vertex_t)), vertices, GL_STREAM_DRAW);
+    gl.EnableVertexAttribArray(ATTR_POS);
+    gl.EnableVertexAttribArray(ATTR_UV);
+    gl.EnableVertexAttribArray(ATTR_COLOUR);
+    gl.VertexAttribPointer(ATTR_POS, 2, GL_FLOAT, GL_FALSE, sizeof(gl_vertex_t),
+                           (const void *)offsetof(gl_vertex_t, x));
+    gl.VertexAttribPointer(ATTR_UV, 2, GL_FLOAT, GL_FALSE, sizeof(gl_vertex_t),
+                           (const void *)offsetof(gl_vertex_t, u));
+    gl.VertexAttribPointer(ATTR_COLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(gl_vertex_t),
+                           (const void *)offsetof(gl_vertex_t, colour));
+
+    draw_range(background_texture, background_w, background_h, 0, 6);
+    if (vertex_count > 6)
+        draw_range(atlas_texture, atlas_w, atlas_h, 6, vertex_count - 6);
+
+    gl.BindTexture(GL_TEXTURE_2D, 0);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl.UseProgram(0);
+    gl.Disable(GL_BLEND);
+}
@@ -0,0 +1,64 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * OpenGL 2.0 / OpenGL ES 2.0 renderer for a libretro hardware context,
+ * built with HAVE_OPENGL (and HAVE_OPENGLES for ES). Every GL function
+ * is looked up through the frontend's get_proc_address, so nothing
+ * links against a GL library.
+ *
+ * A frame is a full screen background texture with a batch of quads
+ * on top, all textured from one atlas. Quads are queued between
+ * gl_render_begin() and gl_render_end(), which draws the whole batch
+ * with a single call and blends with premultiplied alpha. The batch
+ * buffer only ever grows, so a steady frame allocates nothing.
+ *
+ * Atlas texels are RGBA bytes, premultiplied. A sprite quad draws
+ * texel × colour. A shaded quad draws texel.rgb + texel.a × colour,
+ * which lets one texture carry shading that depends on a per-quad
+ * colour (the snake's body); texels with alpha 0 stay transparent.
+ */
+#ifndef SNEK_GL_RENDER_H
+#define SNEK_GL_RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libretro.h"
+
+/* Create the GL objects. Call from the context_reset callback. */
+bool gl_render_init(retro_hw_get_proc_address_t get_proc_address);
+
+/* Forget the GL objects. Call from context_destroy, while the context
+ * is still current. */
+void gl_render_deinit(void);
+
+/* Replace the atlas with w×h RGBA texels. */
+void gl_render_set_atlas(const uint8_t *rgba, int w, int h);
+
+/* Replace the background with w×h XRGB8888 pixels, stride in pixels. */
+void gl_render_set_background(const uint32_t *xrgb, int w, int h, int stride);
+
+void gl_render_begin(void);
+
+/* Queue a w×h quad at (x, y), textured from the atlas texels at
+ * (u, v) of the same size. colour is XRGB8888. */
+void gl_render_sprite(int x, int y, int w, int h, int u, int v, uint32_t colour);
+void gl_render_shaded(int x, int y, int w, int h, int u, int v, uint32_t colour);
+
+/* Queue a w×h quad at (x, y) filled with the single atlas texel at
+ * (u, v) times colour. */
+void gl_render_fill(int x, int y, int w, int h, int u, int v, uint32_t colour);
+
+/* Draw the background and the queued quads into framebuffer object
+ * fbo, whose lower left width×height pixels hold the picture. */
+void gl_render_end(uintptr_t fbo, int width, int height);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Input movies. See movie.h.
+ */
+#include "movie.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MOVIE_MAGIC 0x4D4B4E53u /* "SNKM" read as little endian */
+#define MOVIE_VERSION 1
+
+/* Sanity limits for files read back. */
+#define MOVIE_MAX_STATE (16u << 20)
+#define MOVIE_MAX_RUNS (64u << 20)
+
+void movie_free(movie_t *movie)
+{
+    free(movie->state);
+    free(movie->runs);
+    memset(movie, 0, sizeof(*movie));
+}
+
+bool movie_begin(movie_t *movie, const void *state, size_t state_size)
+{
+    movie_free(movie);
+    movie->state = malloc(state_size);
+    if (!movie->state)
+        return false;
+    memcpy(movie->state, state, state_size);
+    movie->state_size = state_size;
+    return true;
+}
+
+bool movie_record(movie_t *movie, unsigned buttons)
+{
+    movie_run_t *last = movie->run_count ? &movie->runs[movie->run_count - 1] : NULL;
+    if (last && last->buttons == buttons && last->frames < UINT16_MAX)
+    {
+        last->frames++;
+        movie->frames++;
+        return true;
+    }
+    if (movie->run_count == movie->run_capacity)
+    {
+        size_t capacity = movie->run_capacity ? movie->run_capacity * 2 : 256;
+        movie_run_t *runs = (movie_run_t *)realloc(movie->runs, capacity * sizeof(movie_run_t));
+        if (!runs)
+            return false;
+        movie->runs = runs;
+        movie->run_capacity = capacity;
+    }
+    movie->runs[movie->run_count].buttons = (uint16_t)buttons;
+    movie->runs[movie->run_count].frames = 1;
+    movie->run_count++;
+    movie->frames++;
+    return true;
+}
+
+void movie_rewind(movie_t *movie)
+{
+    movie->cursor = 0;
+    movie->run_index = 0;
+    movie->run_offset = 0;
+}
+
+bool movie_play(movie_t *movie, unsigned *buttons)
+{
+    if (movie->run_index >= movie->run_count)
+        return false;
+    const movie_run_t *run = &movie->runs[movie->run_index];
+    *buttons = run->buttons;
+    movie->cursor++;
+    if (++movie->run_offset >= run->frames)
+    {
+        movie->run_index++;
+        movie->run_offset = 0;
+    }
+    return true;
+}
+
+void movie_seek(movie_t *movie, uint32_t frame)
+{
+    if (frame > movie->frames)
+        frame = movie->frames;
+    /* First frame of the current run. */
+    uint32_t start = movie->cursor - movie->run_offset;
+    while (start > frame)
+        start -= movie->runs[--movie->run_index].frames;
+    while (movie->run_index < movie->run_count && start + movie->runs[movie->run_index].frames <= frame)
+        start += movie->runs[movie->run_index++].frames;
+    movie->cursor = frame;
+    movie->run_offset = frame - start;
+}
+
+void movie_truncate(movie_t *movie, uint32_t frames)
+{
+    while (movie->frames > frames)
+    {
+        movie_run_t *last = &movie->runs[movie->run_count - 1];
+        uint32_t cut = movie->frames - frames;
+        if (cut >= last->frames)
+        {
+            movie->frames -= last->frames;
+            movie->run_count--;
+        }
+        else
+        {
+            last->frames = (uint16_t)(last->frames - cut);
+            movie->frames = frames;
+        }
+    }
+}
+
+static bool put(FILE *file, const void *data, size_t size)
+{
+    return fwrite(data, 1, size, file) == size;
+}
+
+static bool get(FILE *file, void *data, size_t size)
+{
+    return fread(data, 1, size, file) == size;
+}
+
+bool movie_write(const movie_t *movie, FILE *file)
+{
+    uint32_t magic = MOVIE_MAGIC;
+    uint16_t version = MOVIE_VERSION, reserved = 0;
+    uint32_t state_size = (uint32_t)movie->state_size;
+    uint32_t frames = movie->frames;
+    uint32_t runs = (uint32_t)movie->run_count;
+    return put(file, &magic, sizeof(magic)) && put(file, &version, sizeof(version)) &&
+           put(file, &reserved, sizeof(reserved)) && put(file, &state_size, sizeof(state_size)) &&
+           put(file, movie->state, movie->state_size) && put(file, &frames, sizeof(frames)) &&
+           put(file, &runs, sizeof(runs)) && put(file, movie->runs, movie->run_count * sizeof(movie_run_t));
+}
+
+bool movie_read(movie_t *movie, FILE *file)
+{
+    movie_free(movie);
+    uint32_t magic, state_size, frames, runs;
+    uint16_t version, reserved;
+    if (!get(file, &magic, sizeof(magic)) || !get(file, &version, sizeof(version)) ||
+        !get(file, &reserved, sizeof(reserved)) || !get(file, &state_size, sizeof(state_size)))
+        return false;
+    if (magic != MOVIE_MAGIC || version != MOVIE_VERSION || state_size > MOVIE_MAX_STATE)
+        return false;
+    movie->state = malloc(state_size ? state_size : 1);
+    movie->state_size = state_size;
+    if (!movie->state || !get(file, movie->state, state_size) || !get(file, &frames, sizeof(frames)) ||
+        !get(file, &runs, sizeof(runs)) || runs > MOVIE_MAX_RUNS)
+        goto fail;
+    movie->runs = (movie_run_t *)malloc((runs ? runs : 1) * sizeof(movie_run_t));
+    movie->run_capacity = runs;
+    if (!movie->runs || !get(file, movie->runs, runs * sizeof(movie_run_t)))
+        goto fail;
+    movie->run_count = runs;
+    /* The runs decide the length; the stored count must agree. */
+    uint64_t total = 0;
+    for (size_t i = 0; i < runs; i++)
+    {
+        if (movie->runs[i].frames == 0)
+            goto fail;
+        total += movie->runs[i].frames;
+    }
+    if (total != frames)
+        goto fail;
+    movie->frames = frames;
+    movie_rewind(movie);
+    return true;
+
+fail:
+    movie_free(movie);
+    return false;
+}
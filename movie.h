@@ -0,0 +1,83 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Input movies: the buttons of every frame, run-length encoded, plus
+ * the save state the recording started from. Because the game is
+ * deterministic given its state and input, loading the state and
+ * feeding the buttons back reproduces the game exactly.
+ *
+ * A run is a button mask (one bit per RETRO_DEVICE_ID_JOYPAD_*) and a
+ * frame count. Holding a direction for a second is a single run, so a
+ * typical game takes a few bytes per second.
+ *
+ * File layout, in native byte order like the save state:
+ *
+ *   "SNKM" magic, u16 version, u16 reserved
+ *   u32 state size, then the start state
+ *   u32 frames, u32 runs, then per run u16 buttons, u16 frames
+ */
+#ifndef SNEK_MOVIE_H
+#define SNEK_MOVIE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct
+{
+    uint16_t buttons;
+    uint16_t frames;
+} movie_run_t;
+
+typedef struct
+{
+    void *state;
+    size_t state_size;
+
+    movie_run_t *runs;
+    size_t run_count, run_capacity;
+    uint32_t frames;
+
+    /* Playback position: frame, and the run it falls into. */
+    uint32_t cursor;
+    size_t run_index;
+    uint32_t run_offset;
+} movie_t;
+
+/* Start a recording from a copy of a save state. Drops any previous
+ * movie. */
+bool movie_begin(movie_t *movie, const void *state, size_t state_size);
+
+/* Append one frame. Returns false if memory runs out. */
+bool movie_record(movie_t *movie, unsigned buttons);
+
+/* Rewind playback to the first frame. */
+void movie_rewind(movie_t *movie);
+
+/* Buttons of the next frame. Returns false at the end of the movie. */
+bool movie_play(movie_t *movie, unsigned *buttons);
+
+/* Move playback to the given frame, or to the end if the movie is
+ * shorter. Walks from the current position, so a seek of a few frames
+ * costs a few runs. */
+void movie_seek(movie_t *movie, uint32_t frame);
+
+/* Drop everything recorded from the given frame on, so recording goes
+ * on from there. Does nothing if the movie is not that long. */
+void movie_truncate(movie_t *movie, uint32_t frames);
+
+bool movie_write(const movie_t *movie, FILE *file);
+bool movie_read(movie_t *movie, FILE *file);
+
+void movie_free(movie_t *movie);
+
+#endif
@@ -0,0 +1,213 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Vectorised pixel operations. Each kernel handles one 128 bit vector
+ * of pixels per iteration and finishes the remainder with the scalar
+ * helpers from pixel_ops.h, so every path produces identical results.
+ */
+#include "pixel_ops.h"
+
+#include <string.h>
+
+/* The SIMD path follows the compiler's target: x86_64 and 64-bit ARM
+ * always have SSE2 and NEON, other targets get them from -msse2,
+ * -mfpu=neon or -msimd128 (see the Makefile). */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_NEON
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#define HAVE_WASM_SIMD
+#include <wasm_simd128.h>
+#endif
+
+void px_scale(uint32_t *dst, const uint32_t *src, size_t count, uint32_t factor)
+{
+    size_t i = 0;
+    if (factor >= PX_ONE)
+    {
+        if (dst != src)
+            memmove(dst, src, count * sizeof(uint32_t));
+        return;
+    }
+#if defined(HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i f = _mm_set1_epi16((short)factor);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(v, zero), f);
+        __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(v, zero), f);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(HAVE_NEON)
+    const uint16_t f = (uint16_t)factor;
+    for (; i + 4 <= count; i += 4)
+    {
+        uint8x16_t v = vreinterpretq_u8_u32(vld1q_u32(src + i));
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+        lo = vcombine_u16(vshrn_n_u32(vmull_n_u16(vget_low_u16(lo), f), 16),
+                          vshrn_n_u32(vmull_n_u16(vget_high_u16(lo), f), 16));
+        hi = vcombine_u16(vshrn_n_u32(vmull_n_u16(vget_low_u16(hi), f), 16),
+                          vshrn_n_u32(vmull_n_u16(vget_high_u16(hi), f), 16));
+        uint8x16_t out = vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+        vst1q_u32(dst + i, vreinterpretq_u32_u8(out));
+    }
+#elif defined(HAVE_WASM_SIMD)
+    const v128_t f = wasm_i16x8_splat((int16_t)factor);
+    for (; i + 4 <= count; i += 4)
+    {
+        v128_t v = wasm_v128_load(src + i);
+        v128_t lo = wasm_u16x8_extend_low_u8x16(v);
+        v128_t hi = wasm_u16x8_extend_high_u8x16(v);
+        lo = wasm_u16x8_narrow_i32x4(wasm_u32x4_shr(wasm_u32x4_extmul_low_u16x8(lo, f), 16),
+                                     wasm_u32x4_shr(wasm_u32x4_extmul_high_u16x8(lo, f), 16));
+        hi = wasm_u16x8_narrow_i32x4(wasm_u32x4_shr(wasm_u32x4_extmul_low_u16x8(hi, f), 16),
+                                     wasm_u32x4_shr(wasm_u32x4_extmul_high_u16x8(hi, f), 16));
+        wasm_v128_store(dst + i, wasm_u8x16_narrow_i16x8(lo, hi));
+    }
+#endif
+    for (; i < count; i++)
+        dst[i] = px_scale1(src[i], factor);
+}
+
+void px_lerp(uint32_t *dst, const uint32_t *src, size_t count, uint32_t colour, uint32_t t)
+{
+    size_t i = 0;
+#if defined(HAVE_SSE2)
+    /* a * (256 - t) + b * t never exceeds 255 * 256, so it fits an
+     * unsigned 16 bit lane. */
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i u = _mm_set1_epi16((short)(256u - t));
+    const __m128i c = _mm_set1_epi32((int)colour);
+    const __m128i bt = _mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), _mm_set1_epi16((short)t));
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), u), bt);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), u), bt);
+        lo = _mm_srli_epi16(lo, 8);
+        hi = _mm_srli_epi16(hi, 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(HAVE_NEON)
+    const uint16_t u = (uint16_t)(256u - t);
+    const uint8x16_t c = vreinterpretq_u8_u32(vdupq_n_u32(colour));
+    const uint16x8_t bt = vmulq_n_u16(vmovl_u8(vget_low_u8(c)), (uint16_t)t);
+    for (; i + 4 <= count; i += 4)
+    {
+        uint8x16_t v = vreinterpretq_u8_u32(vld1q_u32(src + i));
+        uint16x8_t lo = vmlaq_n_u16(bt, vmovl_u8(vget_low_u8(v)), u);
+        uint16x8_t hi = vmlaq_n_u16(bt, vmovl_u8(vget_high_u8(v)), u);
+        uint8x16_t out = vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+        vst1q_u32(dst + i, vreinterpretq_u32_u8(out));
+    }
+#elif defined(HAVE_WASM_SIMD)
+    const v128_t u = wasm_i16x8_splat((int16_t)(256u - t));
+    const v128_t bt = wasm_i16x8_mul(wasm_u16x8_extend_low_u8x16(wasm_i32x4_splat((int32_t)colour)),
+                                     wasm_i16x8_splat((int16_t)t));
+    for (; i + 4 <= count; i += 4)
+    {
+        v128_t v = wasm_v128_load(src + i);
+        v128_t lo = wasm_i16x8_add(wasm_i16x8_mul(wasm_u16x8_extend_low_u8x16(v), u), bt);
+        v128_t hi = wasm_i16x8_add(wasm_i16x8_mul(wasm_u16x8_extend_high_u8x16(v), u), bt);
+        wasm_v128_store(dst + i, wasm_u8x16_narrow_i16x8(wasm_u16x8_shr(lo, 8), wasm_u16x8_shr(hi, 8)));
+    }
+#endif
+    for (; i < count; i++)
+        dst[i] = px_lerp1(src[i], colour, t);
+}
+
+void px_adds(uint32_t *dst, const uint32_t *src, size_t count, uint32_t add)
+{
+    size_t i = 0;
+#if defined(HAVE_SSE2)
+    const __m128i a = _mm_set1_epi32((int)add);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_adds_epu8(v, a));
+    }
+#elif defined(HAVE_NEON)
+    const uint8x16_t a = vreinterpretq_u8_u32(vdupq_n_u32(add));
+    for (; i + 4 <= count; i += 4)
+    {
+        uint8x16_t v = vreinterpretq_u8_u32(vld1q_u32(src + i));
+        vst1q_u32(dst + i, vreinterpretq_u32_u8(vqaddq_u8(v, a)));
+    }
+#elif defined(HAVE_WASM_SIMD)
+    const v128_t a = wasm_i32x4_splat((int32_t)add);
+    for (; i + 4 <= count; i += 4)
+        wasm_v128_store(dst + i, wasm_u8x16_add_sat(wasm_v128_load(src + i), a));
+#endif
+    for (; i < count; i++)
+        dst[i] = px_adds1(src[i], add);
+}
+
+void px_scale565(uint16_t *dst, const uint16_t *src, size_t count, uint32_t factor)
+{
+    size_t i = 0;
+    if (factor >= PX_ONE)
+    {
+        if (dst != src)
+            memmove(dst, src, count * sizeof(uint16_t));
+        return;
+    }
+#if defined(HAVE_SSE2)
+    const __m128i f = _mm_set1_epi16((short)factor);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i r = _mm_mulhi_epu16(_mm_srli_epi16(v, 11), f);
+        __m128i g = _mm_mulhi_epu16(_mm_and_si128(_mm_srli_epi16(v, 5), mask6), f);
+        __m128i b = _mm_mulhi_epu16(_mm_and_si128(v, mask5), f);
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), b);
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+    }
+#elif defined(HAVE_NEON)
+    const uint16_t f = (uint16_t)factor;
+    const uint16x8_t mask6 = vdupq_n_u16(0x3F);
+    const uint16x8_t mask5 = vdupq_n_u16(0x1F);
+#define MULHI(x) vcombine_u16(vshrn_n_u32(vmull_n_u16(vget_low_u16(x), f), 16), \
+                              vshrn_n_u32(vmull_n_u16(vget_high_u16(x), f), 16))
+    for (; i + 8 <= count; i += 8)
+    {
+        uint16x8_t v = vld1q_u16(src + i);
+        uint16x8_t r = MULHI(vshrq_n_u16(v, 11));
+        uint16x8_t g = MULHI(vandq_u16(vshrq_n_u16(v, 5), mask6));
+        uint16x8_t b = MULHI(vandq_u16(v, mask5));
+        vst1q_u16(dst + i, vorrq_u16(vorrq_u16(vshlq_n_u16(r, 11), vshlq_n_u16(g, 5)), b));
+    }
+#undef MULHI
+#elif defined(HAVE_WASM_SIMD)
+    const v128_t f = wasm_i16x8_splat((int16_t)factor);
+    const v128_t mask6 = wasm_i16x8_splat(0x3F);
+    const v128_t mask5 = wasm_i16x8_splat(0x1F);
+#define MULHI(x) wasm_u16x8_narrow_i32x4(wasm_u32x4_shr(wasm_u32x4_extmul_low_u16x8(x, f), 16), \
+                                         wasm_u32x4_shr(wasm_u32x4_extmul_high_u16x8(x, f), 16))
+    for (; i + 8 <= count; i += 8)
+    {
+        v128_t v = wasm_v128_load(src + i);
+        v128_t r = MULHI(wasm_u16x8_shr(v, 11));
+        v128_t g = MULHI(wasm_v128_and(wasm_u16x8_shr(v, 5), mask6));
+        v128_t b = MULHI(wasm_v128_and(v, mask5));
+        wasm_v128_store(dst + i, wasm_v128_or(wasm_v128_or(wasm_i16x8_shl(r, 11), wasm_i16x8_shl(g, 5)), b));
+    }
+#undef MULHI
+#endif
+    for (; i < count; i++)
+        dst[i] = px_scale565_1(src[i], factor);
+}
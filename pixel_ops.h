@@ -0,0 +1,89 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Pixel operations on packed XRGB8888 values, plus scaling of RGB565.
+ *
+ * All XRGB8888 channels (including the unused X byte) are processed
+ * alike, so colours with X == 0 stay that way. The array versions
+ * have SSE2, NEON and WebAssembly SIMD128 implementations, chosen at
+ * compile time from what the compiler targets (see pixel_ops.c);
+ * without any of them a scalar loop is used. The single pixel helpers
+ * below are always scalar. px_scale() and px_scale565() dim whole rows
+ * for the pause and game over screens; px_lerp() and px_adds() have no
+ * caller in the core yet and are checked and timed by snek_bench.
+ */
+#ifndef SNEK_PIXEL_OPS_H
+#define SNEK_PIXEL_OPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Scale factors are 0.16 fixed point. PX_FACTOR rounds up so that
+ * exact fractions (2/5, 1/2 ...) truncate the same way as the float
+ * multiply they replace. */
+#define PX_ONE 65536u
+#define PX_FACTOR(num, den) ((uint32_t)(((uint32_t)(num) * PX_ONE + (uint32_t)(den) - 1) / (uint32_t)(den)))
+
+/* Multiply each channel by factor / 65536, truncating. */
+static inline uint32_t px_scale1(uint32_t c, uint32_t factor)
+{
+    uint32_t out = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+        out |= ((((c >> shift) & 0xFFu) * factor) >> 16) << shift;
+    return out;
+}
+
+/* Blend from a to b; t is in 1/256 steps (0 = a, 256 = b). */
+static inline uint32_t px_lerp1(uint32_t a, uint32_t b, uint32_t t)
+{
+    uint32_t out = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t v = ((a >> shift) & 0xFFu) * (256u - t) + ((b >> shift) & 0xFFu) * t;
+        out |= (v >> 8) << shift;
+    }
+    return out;
+}
+
+/* Per-channel add, saturating at 255. */
+static inline uint32_t px_adds1(uint32_t c, uint32_t add)
+{
+    uint32_t out = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t v = ((c >> shift) & 0xFFu) + ((add >> shift) & 0xFFu);
+        out |= (v > 0xFFu ? 0xFFu : v) << shift;
+    }
+    return out;
+}
+
+/* Multiply each RGB565 field by factor / 65536, truncating. */
+static inline uint16_t px_scale565_1(uint16_t c, uint32_t factor)
+{
+    uint32_t r = ((uint32_t)(c >> 11) * factor) >> 16;
+    uint32_t g = ((uint32_t)((c >> 5) & 0x3Fu) * factor) >> 16;
+    uint32_t b = ((uint32_t)(c & 0x1Fu) * factor) >> 16;
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+/* dst[i] = px_scale1(src[i], factor). dst may equal src. */
+void px_scale(uint32_t *dst, const uint32_t *src, size_t count, uint32_t factor);
+
+/* dst[i] = px_lerp1(src[i], colour, t). dst may equal src. */
+void px_lerp(uint32_t *dst, const uint32_t *src, size_t count, uint32_t colour, uint32_t t);
+
+/* dst[i] = px_adds1(src[i], add). dst may equal src. */
+void px_adds(uint32_t *dst, const uint32_t *src, size_t count, uint32_t add);
+
+/* dst[i] = px_scale565_1(src[i], factor). dst may equal src. */
+void px_scale565(uint16_t *dst, const uint16_t *src, size_t count, uint32_t factor);
+
+#endif
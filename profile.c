@@ -0,0 +1,154 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Frame-time profiler. See profile.h.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "profile.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Values below 8 ns get a bucket each; above that every octave is
+ * split into 8 buckets, which bounds the p99 error to 1/8. */
+#define PROF_SUB_BITS 3
+#define PROF_SUB (1 << PROF_SUB_BITS)
+#define PROF_BUCKETS ((32 - PROF_SUB_BITS + 1) * PROF_SUB)
+
+const char *const prof_stage_names[PROF_STAGES] = {
+    "INPUT", "STEP", "AUTOPILOT", "PARTICLES", "CLEAR", "DRAW PARTS",
+    "DRAW SNAKE", "DRAW FOOD", "DRAW ITEM", "DRAW HUD", "OVERLAY",
+    "DRAW BANDS", "VIDEO", "FRAME"};
+
+typedef struct
+{
+    uint32_t ring[PROF_WINDOW];
+    uint16_t histogram[PROF_BUCKETS];
+    int pos, samples;
+    uint64_t sum;
+    /* The current frame. */
+    uint64_t pending;
+    int calls;
+} prof_window_t;
+
+static prof_window_t windows[PROF_STAGES];
+
+uint64_t prof_now(void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static int bucket_of(uint32_t v)
+{
+    if (v < PROF_SUB)
+        return (int)v;
+    int octave = 31;
+    while (!(v >> octave))
+        octave--;
+    int shift = octave - PROF_SUB_BITS;
+    return (shift + 1) * PROF_SUB + (int)((v >> shift) & (PROF_SUB - 1));
+}
+
+/* Largest value that falls into bucket b. */
+static uint32_t bucket_top(int b)
+{
+    if (b < PROF_SUB)
+        return (uint32_t)b;
+    int shift = b / PROF_SUB - 1;
+    uint64_t low = (uint64_t)(PROF_SUB + b % PROF_SUB) << shift;
+    uint64_t top = low + ((uint64_t)1 << shift) - 1;
+    return top > UINT32_MAX ? UINT32_MAX : (uint32_t)top;
+}
+
+void prof_add(prof_stage_t stage, uint64_t ns)
+{
+    windows[stage].pending += ns;
+    windows[stage].calls++;
+}
+
+void prof_frame_end(void)
+{
+    for (int s = 0; s < PROF_STAGES; s++)
+    {
+        prof_window_t *w = &windows[s];
+        if (!w->calls)
+            continue;
+        uint32_t v = w->pending > UINT32_MAX ? UINT32_MAX : (uint32_t)w->pending;
+        if (w->samples == PROF_WINDOW)
+        {
+            uint32_t old = w->ring[w->pos];
+            w->histogram[bucket_of(old)]--;
+            w->sum -= old;
+        }
+        else
+        {
+            w->samples++;
+        }
+        w->ring[w->pos] = v;
+        w->histogram[bucket_of(v)]++;
+        w->sum += v;
+        w->pos = (w->pos + 1) % PROF_WINDOW;
+        w->pending = 0;
+        w->calls = 0;
+    }
+}
+
+void prof_stats(prof_stage_t stage, prof_stats_t *out)
+{
+    const prof_window_t *w = &windows[stage];
+    memset(out, 0, sizeof(*out));
+    out->samples = w->samples;
+    if (!w->samples)
+        return;
+    uint32_t min = UINT32_MAX, max = 0;
+    for (int i = 0; i < w->samples; i++)
+    {
+        min = w->ring[i] < min ? w->ring[i] : min;
+        max = w->ring[i] > max ? w->ring[i] : max;
+    }
+    out->min = min;
+    out->avg = (uint32_t)(w->sum / (uint64_t)w->samples);
+    /* The sample that 99 percent of the window does not exceed. */
+    int rank = (w->samples * 99 + 99) / 100;
+    int seen = 0;
+    for (int b = 0; b < PROF_BUCKETS; b++)
+    {
+        seen += w->histogram[b];
+        if (seen >= rank)
+        {
+            uint32_t top = bucket_top(b);
+            out->p99 = top < max ? top : max;
+            break;
+        }
+    }
+}
+
+void prof_reset(void)
+{
+    memset(windows, 0, sizeof(windows));
+}
@@ -0,0 +1,72 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Frame-time profiler, built with `make PROFILE=1` (SNEK_PROFILE).
+ *
+ * Each stage of a frame is timed with a monotonic nanosecond clock. A
+ * stage may run several times per frame; its times are summed and
+ * committed by prof_frame_end(), so every stage gets one sample per
+ * frame it ran in. The last PROF_WINDOW samples of each stage are kept
+ * in a ring and in a log scale histogram (8 buckets per octave), which
+ * give the rolling min, average and 99th percentile.
+ */
+#ifndef SNEK_PROFILE_H
+#define SNEK_PROFILE_H
+
+#include <stdint.h>
+
+typedef enum
+{
+    PROF_INPUT,
+    PROF_STEP,
+    PROF_AUTOPILOT,
+    PROF_PARTICLES,
+    PROF_CLEAR,
+    PROF_DRAW_PARTICLES,
+    PROF_DRAW_SNAKE,
+    PROF_DRAW_FOOD,
+    PROF_DRAW_ITEM,
+    PROF_DRAW_HUD,
+    PROF_DRAW_OVERLAY,
+    PROF_DRAW_BANDS,
+    PROF_VIDEO,
+    PROF_FRAME,
+    PROF_STAGES
+} prof_stage_t;
+
+/* Frames in the rolling window. */
+#define PROF_WINDOW 256
+
+/* Upper case names, so the HUD font can show them. */
+extern const char *const prof_stage_names[PROF_STAGES];
+
+typedef struct
+{
+    uint32_t min, avg, p99; /* nanoseconds */
+    int samples;
+} prof_stats_t;
+
+/* Monotonic time in nanoseconds. */
+uint64_t prof_now(void);
+
+/* Charge ns to a stage in the current frame. */
+void prof_add(prof_stage_t stage, uint64_t ns);
+
+/* Commit the current frame's stage times to the windows. */
+void prof_frame_end(void);
+
+/* Rolling statistics of a stage. p99 is the upper edge of its
+ * histogram bucket, capped at the window's maximum. */
+void prof_stats(prof_stage_t stage, prof_stats_t *out);
+
+void prof_reset(void);
+
+#endif
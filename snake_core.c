@@ -17,6 +17,19 @@ stuff is worth it, you can buy me a beer in return.
  * using the libretro API.
  */
 #include "libretro.h"
+#include "pixel_ops.h"
+#include "blit.h"
+#include "snek_sim.h"
+#include "snek_bot.h"
+#include "movie.h"
+#include "audio.h"
+#include "band_pool.h"
+#ifdef HAVE_OPENGL
+#include "gl_render.h"
+#endif
+#ifdef SNEK_PROFILE
+#include "profile.h"
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,44 +42,47 @@ stuff is worth it, you can buy me a beer in return.
 #define M_PI 3.14159265358979323846f
 #endif
 
+/* For the size-specialised drawing helpers. */
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
 /* ------------------------------------------------------------------
  * Configuration constants
  *
- * Adjust these values to tune the game’s behaviour. GRID_W and
- * GRID_H determine how many cells are available in the play field.
- * CELL_SIZE defines the pixel dimension of a single cell. The
- * resolution of the framebuffer is derived from these. A higher
- * resolution allows for smoother shading at the cost of more memory.
+ * Adjust these values to tune the game’s behaviour. The board size
+ * (how many cells are available in the play field) and the pixel
+ * dimension of a single cell are core options, applied by
+ * geometry_apply() when the content is loaded; the resolution of the
+ * framebuffer is derived from them. A higher resolution allows for
+ * smoother shading at the cost of more memory and fill rate.
  */
 
-#define GRID_W 40
-#define GRID_H 30
-#define CELL_SIZE 16
-/* Derived framebuffer dimensions. */
-#define FB_WIDTH (GRID_W * CELL_SIZE)
-#define FB_HEIGHT (GRID_H * CELL_SIZE) /* Extra space at top for HUD */
-
-/* Maximum snake length. In practice this can be GRID_W * GRID_H but
- * we set a reasonable cap to avoid dynamic allocations at runtime. */
-#define MAX_SNAKE_LENGTH (GRID_W * GRID_H)
-
-/* Particle system configuration. Up to this many particles can be
- * active at once. Each collected item spawns a handful of particles. */
-#define MAX_PARTICLES 128
-
-/* Power‑up durations (in frames). 60 frames ≈ 1 second at 60 Hz. */
-#define PHASE_DURATION (60 * 5) /* 5 seconds of phasing */
-#define SPEED_DURATION (60 * 5) /* 5 seconds of speed boost */
-
-/* Movement speed. Lower values produce a faster snake because the
- * snake advances once every MOVE_INTERVAL frames. A speed boost will
- * divide this interval by two. */
-#define BASE_MOVE_INTERVAL 8
-
-/* Probability that a power‑up is spawned when food is consumed.
- * Expressed as a fraction of RAND_MAX. For example 0.2 means
- * 20 percent chance. */
-#define POWERUP_PROBABILITY 0.5f
+/* The classic board: 40×30 cells of 16 pixels, 640×480. The hot
+ * drawing loops have a variant specialised for DEFAULT_CELL_SIZE. */
+#define DEFAULT_GRID_W 40
+#define DEFAULT_GRID_H 30
+#define DEFAULT_CELL_SIZE 16
+
+/* Sprites need at least 8 pixels for their details. Cells are
+ * addressed by uint16_t indices, which bounds the board. The HUD needs
+ * a 320×240 framebuffer; smaller boards get bigger cells. Boards that
+ * would exceed the pixels of a 3840×2160 picture get smaller cells,
+ * which keeps each full-size buffer under 32 MB. */
+#define MIN_CELL_SIZE 8
+#define MAX_CELL_SIZE 32
+#define MAX_GRID_CELLS 65535
+#define MIN_FB_WIDTH 320
+#define MIN_FB_HEIGHT 240
+#define MAX_FB_PIXELS (3840 * 2160)
+
+/* Particle system configuration. Up to snek_particles particles can
+ * be active at once. Each collected item spawns a handful of
+ * particles, one handful per DEFAULT_PARTICLES of pool capacity. */
+#define DEFAULT_PARTICLES 128
+#define MAX_PARTICLES 8192
 
 /* Colours used in the game. Encoded as 0xAARRGGBB but since we
  * request XRGB8888 from the frontend the high byte (alpha) is
@@ -86,6 +102,13 @@ static const colour_t PHASE_COLOUR = RGB(80, 80, 200);
 static const colour_t SPEED_COLOUR = RGB(200, 160, 40);
 static const colour_t HUD_TEXT_COLOUR = RGB(240, 240, 240);
 static const colour_t GAMEOVER_COLOUR = RGB(255, 60, 60);
+/* Body shading: stripes and scale dots are mixed towards these, and a
+ * phasing body towards PHASE_COLOUR. */
+static const colour_t BODY_STRIPE_COLOUR = RGB(40, 120, 40);
+static const colour_t BODY_DOT_COLOUR = RGB(200, 255, 200);
+#define BODY_STRIPE_MIX 0.3f
+#define BODY_DOT_MIX 0.1f
+#define BODY_PHASE_MIX 0.2f
 
 /* Segment definitions for seven‑segment display. Each bit in the
  * 7‑bit mask represents a segment a–g as follows:
@@ -138,6 +161,7 @@ static const glyph_t font_glyphs[] = {
     {'X', {0x44, 0x44, 0x28, 0x10, 0x28, 0x44, 0x44, 0x00}},
     {'Y', {0x44, 0x44, 0x28, 0x10, 0x10, 0x10, 0x3c, 0x00}},
     {'Z', {0x7c, 0x04, 0x08, 0x10, 0x20, 0x40, 0x7c, 0x00}},
+    {'.', {0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00}},
     {'0', {0x38, 0x44, 0x4c, 0x54, 0x64, 0x44, 0x38, 0x00}},
     {'1', {0x10, 0x30, 0x10, 0x10, 0x10, 0x10, 0x38, 0x00}},
     {'2', {0x38, 0x44, 0x04, 0x08, 0x10, 0x20, 0x7c, 0x00}},
@@ -149,18 +173,19 @@ static const glyph_t font_glyphs[] = {
     {'8', {0x38, 0x44, 0x44, 0x38, 0x44, 0x44, 0x38, 0x00}},
     {'9', {0x38, 0x44, 0x44, 0x3c, 0x04, 0x08, 0x30, 0x00}}};
 
-/* Helper to retrieve a glyph bitmap for a character. Returns NULL if
+#define GLYPH_COUNT (sizeof(font_glyphs) / sizeof(font_glyphs[0]))
+
+/* font_glyphs as blit_masked() rows (leftmost column in bit 0), and
+ * a table from character to glyph. Both are filled in by hud_init(). */
+static uint32_t glyph_masks[GLYPH_COUNT][8];
+static const uint32_t *glyph_table[256];
+
+/* Helper to retrieve a glyph mask for a character. Returns NULL if
  * the character is undefined; undefined characters simply aren’t
  * drawn. */
-static const uint8_t *get_glyph_bitmap(char c)
+static const uint32_t *get_glyph_mask(char c)
 {
-    size_t n = sizeof(font_glyphs) / sizeof(font_glyphs[0]);
-    for (size_t i = 0; i < n; ++i)
-    {
-        if (font_glyphs[i].ch == c)
-            return font_glyphs[i].bitmap;
-    }
-    return NULL;
+    return glyph_table[(unsigned char)c];
 }
 
 /* Game state enumeration. */
@@ -172,72 +197,123 @@ typedef enum
     STATE_GAMEOVER
 } game_state_t;
 
-/* Directions used by the snake. */
-typedef enum
-{
-    DIR_UP,
-    DIR_DOWN,
-    DIR_LEFT,
-    DIR_RIGHT
-} direction_t;
-
-/* Power‑up types. */
-typedef enum
-{
-    ITEM_NONE = 0,
-    ITEM_PHASE,
-    ITEM_SPEED
-} item_type_t;
-
-/* Particle structure for simple explosion effects. */
+/* Particle pool for simple explosion effects, as a structure of
+ * arrays. The live particles are packed at the front: entries below
+ * count are alive and a dying particle is replaced by the last one.
+ * Positions and velocities are 16.16 fixed point pixels. */
 typedef struct
 {
-    float x, y;
-    float vx, vy;
-    int lifetime;
-    colour_t colour;
-    bool active;
-} particle_t;
+    int32_t *x, *y;
+    int32_t *vx, *vy;
+    int32_t *lifetime;
+    colour_t *colour;
+    int count;
+    int capacity;
+} particle_pool_t;
+
+/* Board geometry, see geometry_apply(). grid_cells is also the
+ * maximum snake length. */
+static int grid_w = 0;
+static int grid_h = 0;
+static int grid_cells = 0;
+static int cell_size = 0;
+static int fb_width = 0;
+static int fb_height = 0;
+/* Words in a bitset with one bit per cell. */
+#define GRID_WORDS ((grid_cells + 31) / 32)
+
+/* Global video buffer, in pixel_format. */
+static void *video_buffer = NULL;
+static surface_t screen;
+
+#ifdef HAVE_OPENGL
+/* Hardware rendering (snek_renderer), see draw_frame_gl(). hw_enabled
+ * once the frontend accepted SET_HW_RENDER, hw_ready while its context
+ * is alive. The atlas and background textures are uploaded again when
+ * the layers they copy were rebuilt. */
+static struct retro_hw_render_callback hw_render;
+static bool hw_enabled = false;
+static bool hw_ready = false;
+static bool hw_atlas_stale = true;
+static bool hw_background_stale = true;
+#endif
 
-/* Global video buffer. Each pixel uses 32‑bit XRGB8888. */
-static colour_t *video_buffer = NULL;
+/* Format of the framebuffer and of every layer drawn into it. Colours
+ * are defined as XRGB8888 and converted with native_colour() where
+ * they are drawn; the cached sprites are converted once. */
+static surface_format_t pixel_format = SURFACE_XRGB8888;
 static size_t video_pitch = 0;
 
-/* Snake body positions. head index at 0, tail at length-1. */
-static int snake_x[MAX_SNAKE_LENGTH];
-static int snake_y[MAX_SNAKE_LENGTH];
-static int snake_length = 0;
-static direction_t snake_dir = DIR_RIGHT;
-static direction_t pending_dir = DIR_RIGHT;
-
-/* Fruit and power‑up positions. If item_type is ITEM_NONE no power‑up
- * is present. */
-static int food_x, food_y;
-static item_type_t item_type = ITEM_NONE;
-static int item_x, item_y;
-
-/* Timers for active power‑ups. When >0 the effect is active. */
-static int phase_timer = 0;
-static int speed_timer = 0;
-
-/* Particle pool. */
-static particle_t particles[MAX_PARTICLES];
-
-/* Add obstacle grid and collision detection */
-static int obstacle[GRID_W][GRID_H];
-static int obstacle_count = 0;
-
-/* Current score and high score. */
-static int score = 0;
-static int highscore = 0;
-
-/* Game state and frame counters. move_counter counts down to the
- * snake’s next step. frame_count increments every call to retro_run
- * and is used for animations. */
+/* The game itself, see snek_sim.h. */
+static snek_sim_t sim;
+/* Body cells of a state being loaded, one per board cell. */
+static uint16_t *state_body = NULL;
+
+/* Particle pool, see particle_pool_setup(). */
+static particle_pool_t particles;
+
+/* Screen state and frame counter. frame_count increments every game
+ * tick and is used for animations. */
 static game_state_t state = STATE_TITLE;
-static int move_counter = BASE_MOVE_INTERVAL;
 static unsigned long frame_count = 0;
 
+/* Fixed timestep. The game always ticks TICK_RATE times a second; the
+ * display runs at display_rate (snek_refresh_rate) and retro_run()
+ * runs as many ticks as are due, carrying the rest in
+ * tick_accumulator (in 1/display_rate ticks). tick_fraction is how far
+ * the next tick is, in 16.16, for drawing moving things in between. */
+#define TICK_RATE 60
+#define SAMPLE_RATE AUDIO_SAMPLE_RATE
+#define MIN_DISPLAY_RATE 50
+static unsigned display_rate = TICK_RATE;
+static unsigned tick_accumulator = 0;
+static int32_t tick_fraction = 0;
+/* Buttons seen since the last tick, so that a tap between two ticks is
+ * not lost on a fast display. Saved with tick_accumulator, so a loaded
+ * state ticks on the same frames as the game it came from. */
+static unsigned input_latch = 0;
+
+/* Sound effects (snek_sound). audio_accumulator carries the audio
+ * frames owed, in 1/display_rate frames; it and the voices are saved,
+ * so sounds play on across a load. The frontend's buffer occupancy
+ * comes from SET_AUDIO_BUFFER_STATUS_CALLBACK when it has one. */
+static bool sound_enabled = true;
+static audio_voices_t voices;
+static unsigned audio_accumulator = 0;
+static bool audio_status_active = false;
+static unsigned audio_occupancy = 0;
+static bool audio_underrun_likely = false;
+
+static void RETRO_CALLCONV audio_buffer_status(bool active, unsigned occupancy, bool underrun_likely)
+{
+    audio_status_active = active;
+    audio_occupancy = occupancy;
+    audio_underrun_likely = underrun_likely;
+}
+
+/* Autopilot (snek_autopilot): the core plays by itself, as for
+ * attract mode. It steers every move and, after autopilot_wait ticks
+ * on the title or game over screen, starts a new game. The wait is
+ * part of the save state; the bot's field is rebuilt after a load. */
+#define AUTOPILOT_WAIT (2 * TICK_RATE)
+static bool autopilot = false;
+static snek_bot_t bot;
+static unsigned autopilot_wait = AUTOPILOT_WAIT;
+
+/* Start and Select as seen by the previous handle_input(), for edge
+ * detection. Part of the save state. */
+static int prev_start = 0;
+static int prev_select = 0;
+/* Directions held at the previous handle_input(), and those pressed
+ * that the snake could not take yet, one bit per snek_dir_t. Also part
+ * of the save state. */
+static unsigned prev_dirs = 0;
+static unsigned retry_dirs = 0;
+
+/* Random stream for effects, kept apart from the game's own so that
+ * effects never change how a game plays out. Saved with the game. */
+static uint64_t fx_rng_state = 0;
+
 /* Libretro callback pointers set by the frontend. */
 static retro_environment_t env_cb;
 static retro_video_refresh_t video_cb;
@@ -248,233 +324,417 @@ static retro_input_state_t input_state_cb;
 
 /* Forward declarations of internal functions. */
 static void game_reset(void);
-static void spawn_food(void);
-static void spawn_item(void);
-static void update_snake(void);
-static void draw_frame(void);
-static void draw_cell(int cx, int cy, colour_t colour, bool shaded);
-static void draw_snake(void);
-static void draw_food(void);
-static void draw_item(void);
-static void draw_scoreboard(void);
-static void draw_text(int x, int y, const char *text, colour_t colour);
-static void draw_digit(int x, int y, int value, colour_t colour);
-static void draw_gameover_overlay(void);
+static void draw_frame(const surface_t *s);
+static void draw_snake(const surface_t *s);
+static void draw_food(const surface_t *s);
+static void draw_item(const surface_t *s);
+static void draw_scoreboard(const surface_t *s);
+static void draw_text(const surface_t *s, int x, int y, const char *text, colour_t colour);
+static void draw_gameover_overlay(const surface_t *s);
+static void draw_overlay(const surface_t *s);
 static void update_particles(void);
 static void spawn_particles(int cx, int cy, colour_t colour);
-static void spawn_obstacles(void);
-static void draw_obstacles(void);
-static bool check_obstacle_collision(int new_x, int new_y);
+static void draw_obstacles(const surface_t *s);
+static void sprite_bake(int id);
 
-/* Utility to compute a linear interpolation between two colours. */
-static inline colour_t lerp_colour(colour_t a, colour_t b, float t)
+/* ------------------------------------------------------------------
+ * Profiler
+ *
+ * With SNEK_PROFILE (make PROFILE=1) the stages of retro_run() are
+ * timed into the rolling windows of profile.h. The snek_profiler
+ * option shows them on screen, they go to the frontend log every
+ * PROFILE_LOG_FRAMES frames, and each stage is also a frontend
+ * performance counter if the frontend has the interface. Without
+ * SNEK_PROFILE the PROFILE_* macros compile to nothing.
+ */
+#ifdef SNEK_PROFILE
+#define PROFILE_LOG_FRAMES 600
+/* The overlay numbers only change this often, so they can be read. */
+#define PROFILE_OVERLAY_FRAMES 30
+
+static retro_log_printf_t log_cb;
+static struct retro_perf_callback perf_cb;
+static struct retro_perf_counter perf_counters[PROF_STAGES];
+static bool profile_overlay = false;
+static prof_stats_t profile_shown[PROF_STAGES];
+/* Set while render threads draw bands. Their stages overlap and the
+ * counters are not shared safely, so only the whole is timed. */
+static bool profile_paused = false;
+
+static inline uint64_t profile_begin(prof_stage_t stage)
 {
-    uint8_t ar = (a >> 16) & 0xFF;
-    uint8_t ag = (a >> 8) & 0xFF;
-    uint8_t ab = a & 0xFF;
-    uint8_t br = (b >> 16) & 0xFF;
-    uint8_t bg = (b >> 8) & 0xFF;
-    uint8_t bb = b & 0xFF;
-    uint8_t r = (uint8_t)((1.f - t) * ar + t * br);
-    uint8_t g = (uint8_t)((1.f - t) * ag + t * bg);
-    uint8_t b2 = (uint8_t)((1.f - t) * ab + t * bb);
-    return (r << 16) | (g << 8) | b2;
+    if (profile_paused)
+        return 0;
+    if (perf_cb.perf_start)
+        perf_cb.perf_start(&perf_counters[stage]);
+    return prof_now();
 }
 
-/* Initialise a new game. Resets the snake, spawns food and resets
- * timers and counters. */
-static void game_reset(void)
+static inline void profile_end(prof_stage_t stage, uint64_t start)
 {
-    snake_length = 3;
-    snake_x[0] = GRID_W / 2;
-    snake_y[0] = GRID_H / 2;
-    snake_x[1] = snake_x[0] - 1;
-    snake_y[1] = snake_y[0];
-    snake_x[2] = snake_x[1] - 1;
-    snake_y[2] = snake_y[1];
-    snake_dir = DIR_RIGHT;
-    pending_dir = DIR_RIGHT;
-    score = 0;
-    phase_timer = 0;
-    speed_timer = 0;
-    item_type = ITEM_NONE;
-    move_counter = BASE_MOVE_INTERVAL;
-    frame_count = 0;
-    /* deactivate particles */
-    for (int i = 0; i < MAX_PARTICLES; i++)
-        particles[i].active = false;
-    // Reset obstacles
-    for (int x = 0; x < GRID_W; x++)
-        for (int y = 0; y < GRID_H; y++)
-            obstacle[x][y] = 0;
-    obstacle_count = 0;
-    spawn_food();
-    spawn_obstacles();
-}
-
-/* Generate a random cell coordinate that does not collide with the
- * snake. This helper loops until a free cell is found. */
-static void random_free_cell(int *out_x, int *out_y)
-{
-    while (1)
-    {
-        int x = rand() % GRID_W;
-        int y = rand() % GRID_H;
-        bool collides = false;
-        // Check snake collision
-        for (int i = 0; i < snake_length; i++)
-        {
-            if (snake_x[i] == x && snake_y[i] == y)
-            {
-                collides = true;
-                break;
-            }
-        }
-        // Check obstacle collision
-        if (!collides && obstacle[x][y])
-            collides = true;
-        // Check item collision
-        if (!collides && item_type != ITEM_NONE && item_x == x && item_y == y)
-            collides = true;
-        if (!collides)
+    if (profile_paused)
+        return;
+    prof_add(stage, prof_now() - start);
+    if (perf_cb.perf_stop)
+        perf_cb.perf_stop(&perf_counters[stage]);
+}
+
+/* Time the code between the two within one block. */
+#define PROFILE_BEGIN(stage) uint64_t profile_start_##stage = profile_begin(stage)
+#define PROFILE_END(stage) profile_end(stage, profile_start_##stage)
+
+/* Find the frontend's log and performance interfaces and start with
+ * empty windows. */
+static void profile_init(void)
+{
+    struct retro_log_callback logging;
+    log_cb = env_cb(RETRO_ENVIRONMENT_GET_LOG_INTERFACE, &logging) ? logging.log : NULL;
+    memset(&perf_cb, 0, sizeof(perf_cb));
+    if (env_cb(RETRO_ENVIRONMENT_GET_PERF_INTERFACE, &perf_cb) && perf_cb.perf_register &&
+        perf_cb.perf_start && perf_cb.perf_stop)
+    {
+        for (int s = 0; s < PROF_STAGES; s++)
         {
-            *out_x = x;
-            *out_y = y;
-            return;
+            memset(&perf_counters[s], 0, sizeof(perf_counters[s]));
+            perf_counters[s].ident = prof_stage_names[s];
+            perf_cb.perf_register(&perf_counters[s]);
         }
     }
+    else
+    {
+        memset(&perf_cb, 0, sizeof(perf_cb));
+    }
+    prof_reset();
 }
 
-/* Spawn food at a random free location. */
-static void spawn_food(void)
+static void profile_log(void)
 {
-    random_free_cell(&food_x, &food_y);
+    log_cb(RETRO_LOG_INFO, "[snek] frame times over the last %d frames in us (min/avg/p99):\n", PROF_WINDOW);
+    for (int s = 0; s < PROF_STAGES; s++)
+    {
+        prof_stats_t st;
+        prof_stats((prof_stage_t)s, &st);
+        if (st.samples)
+            log_cb(RETRO_LOG_INFO, "[snek]   %-10s %8.2f %8.2f %8.2f\n", prof_stage_names[s],
+                   st.min / 1000.0, st.avg / 1000.0, st.p99 / 1000.0);
+    }
 }
 
-/* Spawn a power‑up with a random type and position. Only spawn if
- * none is currently active. The chance of spawning is governed by
- * POWERUP_PROBABILITY. */
-static void spawn_item(void)
+static void profile_frame_end(void)
 {
-    if (item_type != ITEM_NONE)
-        return;
-    if (((float)rand() / (float)RAND_MAX) > POWERUP_PROBABILITY)
+    static unsigned long frames = 0;
+    prof_frame_end();
+    frames++;
+    if (profile_overlay && frames % PROFILE_OVERLAY_FRAMES == 0)
+    {
+        for (int s = 0; s < PROF_STAGES; s++)
+            prof_stats((prof_stage_t)s, &profile_shown[s]);
+    }
+    if (log_cb && frames % PROFILE_LOG_FRAMES == 0)
+        profile_log();
+}
+#else
+#define PROFILE_BEGIN(stage) ((void)0)
+#define PROFILE_END(stage) ((void)0)
+#endif
+
+static inline uint32_t native_colour(colour_t c)
+{
+    return surface_colour(pixel_format, c);
+}
+
+/* Utility to compute a linear interpolation between two colours. The
+ * blend itself is done in 1/256 fixed point. */
+static inline colour_t lerp_colour(colour_t a, colour_t b, float t)
+{
+    return px_lerp1(a, b, (uint32_t)(t * 256.f + 0.5f));
+}
+
+/* Start a new game and clear the effects. */
+static void game_reset(void)
+{
+    /* No board, see check_variables(). */
+    if (!grid_cells)
         return;
-    /* Decide which item to spawn. We currently choose between
-     * phasing and speed boost with equal probability. */
-    item_type = (rand() % 2) ? ITEM_PHASE : ITEM_SPEED;
-    random_free_cell(&item_x, &item_y);
+    snek_sim_reset(&sim);
+    frame_count = 0;
+    /* deactivate particles */
+    particles.count = 0;
+}
+
+/* Particle directions: PARTICLE_DIRECTIONS unit vectors around the
+ * circle, 16.16 fixed point, filled in by particles_init(). */
+#define PARTICLE_DIRECTIONS 256
+/* Lifetimes are 30 to 59 frames; a particle fades by lifetime / 60
+ * each frame. */
+#define PARTICLE_MIN_LIFETIME 30
+#define PARTICLE_LIFETIME_RANGE 30
+#define PARTICLE_FADE_FRAMES 60
+
+static int32_t particle_dir_x[PARTICLE_DIRECTIONS];
+static int32_t particle_dir_y[PARTICLE_DIRECTIONS];
+static uint32_t particle_fade[PARTICLE_FADE_FRAMES];
+
+static void particles_init(void)
+{
+    for (int i = 0; i < PARTICLE_DIRECTIONS; i++)
+    {
+        float angle = (float)i * 2.0f * (float)M_PI / PARTICLE_DIRECTIONS;
+        particle_dir_x[i] = (int32_t)lroundf(cosf(angle) * 65536.0f);
+        particle_dir_y[i] = (int32_t)lroundf(sinf(angle) * 65536.0f);
+    }
+    for (int i = 0; i < PARTICLE_FADE_FRAMES; i++)
+        particle_fade[i] = PX_FACTOR(i, PARTICLE_FADE_FRAMES);
 }
 
 /* Spawn an explosion of particles at a given cell. */
 static void spawn_particles(int cx, int cy, colour_t colour)
 {
     /* Convert cell coordinates to pixel centre. */
-    float px = (float)cx * CELL_SIZE + CELL_SIZE / 2.0f;
-    float py = (float)cy * CELL_SIZE + CELL_SIZE / 2.0f;
-    for (int i = 0; i < MAX_PARTICLES; i++)
+    int32_t px = (int32_t)((cx * cell_size * 2 + cell_size) << 15);
+    int32_t py = (int32_t)((cy * cell_size * 2 + cell_size) << 15);
+    int handfuls = particles.capacity / DEFAULT_PARTICLES;
+    for (int h = 0; h < handfuls; h++)
     {
-        if (!particles[i].active)
+        while (particles.count < particles.capacity)
         {
-            particles[i].active = true;
-            particles[i].x = px;
-            particles[i].y = py;
-            float angle = (float)rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
-            float speed = 0.5f + ((float)rand() / (float)RAND_MAX) * 1.5f;
-            particles[i].vx = cosf(angle) * speed;
-            particles[i].vy = sinf(angle) * speed;
-            particles[i].lifetime = 30 + rand() % 30;
-            particles[i].colour = colour;
+            int i = particles.count++;
+            particles.x[i] = px;
+            particles.y[i] = py;
+            uint32_t dir = snek_rng_below(&fx_rng_state, PARTICLE_DIRECTIONS);
+            /* 0.5 to 2 pixels per frame. */
+            int64_t speed = 32768 + snek_rng_below(&fx_rng_state, 3 * 32768);
+            particles.vx[i] = (int32_t)((particle_dir_x[dir] * speed) >> 16);
+            particles.vy[i] = (int32_t)((particle_dir_y[dir] * speed) >> 16);
+            particles.lifetime[i] = PARTICLE_MIN_LIFETIME + (int32_t)snek_rng_below(&fx_rng_state, PARTICLE_LIFETIME_RANGE);
+            particles.colour[i] = colour;
             /* spawn only a handful per cell */
-            if (rand() % 2 == 0)
+            if (snek_rng_below(&fx_rng_state, 2) == 0)
                 break;
         }
     }
 }
 
-/* Update all active particles. Moves them and decrements lifetime. */
+/* Update all active particles. Moves them and decrements lifetime. The
+ * motion is a plain pass over the arrays, which the compiler can
+ * vectorise; dead particles are then swapped out. */
 static void update_particles(void)
 {
-    for (int i = 0; i < MAX_PARTICLES; i++)
+    int n = particles.count;
+    int32_t *restrict x = particles.x;
+    int32_t *restrict y = particles.y;
+    int32_t *restrict life = particles.lifetime;
+    const int32_t *restrict vx = particles.vx;
+    const int32_t *restrict vy = particles.vy;
+    for (int i = 0; i < n; i++)
+    {
+        x[i] += vx[i];
+        y[i] += vy[i];
+        life[i]--;
+    }
+    for (int i = 0; i < n;)
+    {
+        if (life[i] <= 0)
+        {
+            n--;
+            particles.x[i] = particles.x[n];
+            particles.y[i] = particles.y[n];
+            particles.vx[i] = particles.vx[n];
+            particles.vy[i] = particles.vy[n];
+            particles.lifetime[i] = particles.lifetime[n];
+            particles.colour[i] = particles.colour[n];
+            continue;
+        }
+        /* Fade out: make colour darker over time. */
+        particles.colour[i] = px_scale1(particles.colour[i], particle_fade[life[i]]);
+        i++;
+    }
+    particles.count = n;
+}
+
+/* ------------------------------------------------------------------
+ * Sprite cache
+ *
+ * The cell sprites only depend on a handful of inputs (obstacle
+ * speckle variant, direction, colour, phasing) so each is rendered
+ * procedurally into one contiguous atlas and blitted row by row
+ * afterwards. Each row of a sprite is stored as a list of opaque runs
+ * so transparent pixels cost nothing.
+ *
+ * sprites_init() only allocates the atlas and bakes the body classes.
+ * A sprite is baked by sprite_bake() the first time it is needed: the
+ * obstacles by draw_obstacles() while the background layer is rebuilt,
+ * the head, food and power-ups by sprites_prepare() at the start of
+ * render_frame(), and all of them by hw_upload_atlas() for the GPU.
+ * Baking writes the atlas, so it must happen on the main thread before
+ * drawing; the bands drawn by band_pool_run() only read it.
+ *
+ * Body segments darken continuously towards the tail and therefore
+ * cannot be baked per segment. Their pixels fall into a few shading
+ * classes (plain, stripe, scale dot, both), so the body sprite stores
+ * class indices and each segment only computes a four entry palette.
+ */
+#define SPRITE_PIXELS (cell_size * cell_size)
+/* Transparent marker used while baking. Real colours never set the
+ * high byte. */
+#define SPRITE_KEY 0xFF000000u
+
+/* The speckle pattern on obstacles repeats every 17 cells. */
+#define OBSTACLE_VARIANTS 17
+
+/* Colours a snake head can be drawn with. */
+static const colour_t *const head_colours[] = {&SNAKE_HEAD_COLOUR, &PHASE_COLOUR, &SPEED_COLOUR};
+#define HEAD_COLOURS (sizeof(head_colours) / sizeof(head_colours[0]))
+
+enum
+{
+    SPRITE_OBSTACLE = 0,
+    SPRITE_FOOD = SPRITE_OBSTACLE + OBSTACLE_VARIANTS,
+    SPRITE_ITEM_PHASE,
+    SPRITE_ITEM_SPEED,
+    /* Indexed by (colour * 2 + phasing) * 4 + direction. */
+    SPRITE_HEAD,
+    SPRITE_COUNT = SPRITE_HEAD + HEAD_COLOURS * 2 * 4
+};
+
+/* Body shading classes. 0 is transparent. */
+enum
+{
+    BODY_CLASS_NONE = 0,
+    BODY_CLASS_PLAIN,
+    BODY_CLASS_STRIPE,
+    BODY_CLASS_DOT,
+    BODY_CLASS_STRIPE_DOT,
+    BODY_CLASS_COUNT
+};
+
+#ifdef HAVE_OPENGL
+/* The hardware renderer's atlas, cell_size texels wide: the sprites
+ * one above the other, the two body shading cells (plain, phasing),
+ * the glyphs 8 rows each, then a row with a white texel for fills and
+ * the texel that dims the overlays. */
+#define HW_ATLAS_BODY_Y (SPRITE_COUNT * cell_size)
+#define HW_ATLAS_GLYPH_Y (HW_ATLAS_BODY_Y + 2 * cell_size)
+#define HW_ATLAS_TEXEL_Y (HW_ATLAS_GLYPH_Y + (int)GLYPH_COUNT * 8)
+#define HW_ATLAS_HEIGHT (HW_ATLAS_TEXEL_Y + 1)
+#endif
+
+typedef struct
+{
+    uint8_t start, len;
+} sprite_run_t;
+
+typedef struct
+{
+    uint8_t run_count[MAX_CELL_SIZE];
+    sprite_run_t runs[MAX_CELL_SIZE][MAX_CELL_SIZE / 2];
+} sprite_runs_t;
+
+/* Baked for the current cell_size: the body classes by sprites_init(),
+ * each sprite on demand by sprite_bake(), which sets sprite_ready[].
+ * See above for who calls it; never from the render bands. */
+static colour_t *sprite_atlas = NULL;
+static uint16_t *sprite_atlas565 = NULL;
+static sprite_runs_t sprite_runs[SPRITE_COUNT];
+static bool sprite_ready[SPRITE_COUNT];
+static uint8_t *body_classes = NULL;
+static sprite_runs_t body_runs;
+
+/* Collect the opaque runs of a baked sprite. is_opaque() decides per
+ * pixel. */
+static void sprite_build_runs(sprite_runs_t *runs, const void *pixels,
+                              bool (*is_opaque)(const void *pixels, int i))
+{
+    for (int y = 0; y < cell_size; y++)
     {
-        if (particles[i].active)
+        int n = 0;
+        int x = 0;
+        while (x < cell_size)
         {
-            particles[i].x += particles[i].vx;
-            particles[i].y += particles[i].vy;
-            particles[i].lifetime--;
-            if (particles[i].lifetime <= 0)
+            if (!is_opaque(pixels, y * cell_size + x))
             {
-                particles[i].active = false;
+                x++;
                 continue;
             }
-            /* Fade out: make colour darker over time. */
-            float t = (float)particles[i].lifetime / 60.0f;
-            uint8_t r = (particles[i].colour >> 16) & 0xFF;
-            uint8_t g = (particles[i].colour >> 8) & 0xFF;
-            uint8_t b = particles[i].colour & 0xFF;
-            r = (uint8_t)(r * t);
-            g = (uint8_t)(g * t);
-            b = (uint8_t)(b * t);
-            particles[i].colour = (r << 16) | (g << 8) | b;
+            int start = x;
+            while (x < cell_size && is_opaque(pixels, y * cell_size + x))
+                x++;
+            runs->runs[y][n].start = (uint8_t)start;
+            runs->runs[y][n].len = (uint8_t)(x - start);
+            n++;
         }
+        runs->run_count[y] = (uint8_t)n;
     }
 }
 
-/* Add obstacle grid and collision detection */
-static int obstacle[GRID_W][GRID_H];
+static bool colour_is_opaque(const void *pixels, int i)
+{
+    return ((const colour_t *)pixels)[i] != SPRITE_KEY;
+}
+
+static bool class_is_opaque(const void *pixels, int i)
+{
+    return ((const uint8_t *)pixels)[i] != BODY_CLASS_NONE;
+}
 
-/* Spawn obstacles at random positions */
-static void spawn_obstacles(void)
+/* The part of grid cell (cx, cy) inside a surface's clip rectangle,
+ * in cell-local pixels. Returns false when none of it is visible. */
+static bool cell_clip(const surface_t *s, int cx, int cy, int *x0, int *y0, int *x1, int *y1)
 {
-    // Set border cells as obstacles
-    for (int x = 0; x < GRID_W; x++)
-    {
-        obstacle[x][0] = 1;
-        obstacle[x][GRID_H - 1] = 1;
-    }
-    for (int y = 0; y < GRID_H; y++)
-    {
-        obstacle[0][y] = 1;
-        obstacle[GRID_W - 1][y] = 1;
-    }
-    obstacle_count = 2 * (GRID_W + GRID_H) - 4;
-    // Optionally, you can still spawn random obstacles inside the border if desired
-    int num_obstacles = GRID_W * GRID_H / 100;
-    for (int i = 0; i < num_obstacles; i++)
+    int px = cx * cell_size;
+    int py = cy * cell_size;
+    *x0 = s->clip_x0 > px ? s->clip_x0 - px : 0;
+    *y0 = s->clip_y0 > py ? s->clip_y0 - py : 0;
+    *x1 = s->clip_x1 < px + cell_size ? s->clip_x1 - px : cell_size;
+    *y1 = s->clip_y1 < py + cell_size ? s->clip_y1 - py : cell_size;
+    return *x0 < *x1 && *y0 < *y1;
+}
+
+/* Copy a cached sprite of size×size pixels into the given cell of a
+ * surface. Always inlined so that the DEFAULT_CELL_SIZE call below is
+ * compiled with a constant size. */
+static ALWAYS_INLINE void draw_sprite_sized(const surface_t *s, int id, int cx, int cy, int size)
+{
+    int x0, y0, x1, y1;
+    if (!cell_clip(s, cx, cy, &x0, &y0, &x1, &y1))
+        return;
+    /* Rows are copied as bytes, so this works for either format. */
+    size_t bpp = (size_t)s->bytes_per_pixel;
+    const uint8_t *atlas = s->format == SURFACE_RGB565 ? (const uint8_t *)sprite_atlas565
+                                                       : (const uint8_t *)sprite_atlas;
+    const uint8_t *src = atlas + ((size_t)id * size * size + (size_t)y0 * size) * bpp;
+    const sprite_runs_t *runs = &sprite_runs[id];
+    for (int y = y0; y < y1; y++, src += size * bpp)
     {
-        int x, y;
-        do
+        uint8_t *dst = surface_pixel(s, cx * size, cy * size + y);
+        for (int r = 0; r < runs->run_count[y]; r++)
         {
-            x = rand() % GRID_W;
-            y = rand() % GRID_H;
-        } while (
-            (snake_x[0] == x && snake_y[0] == y) ||
-            (food_x == x && food_y == y) ||
-            (item_type != ITEM_NONE && item_x == x && item_y == y) ||
-            obstacle[x][y]);
-        obstacle[x][y] = 1;
-        obstacle_count++;
+            const sprite_run_t *run = &runs->runs[y][r];
+            int start = run->start > x0 ? run->start : x0;
+            int end = run->start + run->len < x1 ? run->start + run->len : x1;
+            if (start < end)
+                memcpy(dst + start * bpp, src + start * bpp, (size_t)(end - start) * bpp);
+        }
     }
 }
 
-/* Check for obstacle collisions */
-static bool check_obstacle_collision(int new_x, int new_y)
+static void draw_sprite_to(const surface_t *s, int id, int cx, int cy)
 {
-    return (new_x >= 0 && new_x < GRID_W && new_y >= 0 && new_y < GRID_H && obstacle[new_x][new_y]);
+    if (cell_size == DEFAULT_CELL_SIZE)
+        draw_sprite_sized(s, id, cx, cy, DEFAULT_CELL_SIZE);
+    else
+        draw_sprite_sized(s, id, cx, cy, cell_size);
 }
 
-/* Draw obstacles on the grid */
-// Fancy pixel art for obstacles: stone block with cracks and highlights
-static void draw_obstacle_pixelart(int cx, int cy)
+/* Fancy pixel art for obstacles: stone block with cracks and highlights */
+static void bake_obstacle_sprite(colour_t *dst, int variant)
 {
-    int px = cx * CELL_SIZE;
-    int py = cy * CELL_SIZE;
-    for (int y = 0; y < CELL_SIZE; y++)
+    for (int y = 0; y < cell_size; y++)
     {
-        for (int x = 0; x < CELL_SIZE; x++)
+        for (int x = 0; x < cell_size; x++)
         {
             // Base stone color with vertical gradient
-            float t = (float)y / (float)CELL_SIZE;
+            float t = (float)y / (float)cell_size;
             uint8_t r = 110 + (uint8_t)(30 * t);
             uint8_t g = 110 + (uint8_t)(30 * t);
             uint8_t b = 110 + (uint8_t)(30 * t);
@@ -486,183 +746,93 @@ static void draw_obstacle_pixelart(int cx, int cy)
                 b = (uint8_t)(b + 40);
             }
             // Shadow bottom/right
-            if (x > CELL_SIZE - 3 || y > CELL_SIZE - 3)
+            if (x > cell_size - 3 || y > cell_size - 3)
             {
                 r = (uint8_t)(r * 0.7f);
                 g = (uint8_t)(g * 0.7f);
                 b = (uint8_t)(b * 0.7f);
             }
             // Random speckles for stone texture
-            if (((x * y + cx * 13 + cy * 7) % 17) == 0)
+            if (((x * y + variant) % OBSTACLE_VARIANTS) == 0)
             {
                 r = (uint8_t)(r * 0.8f);
                 g = (uint8_t)(g * 0.8f);
                 b = (uint8_t)(b * 0.8f);
             }
             // Cracks: draw a few dark lines
-            if ((x == CELL_SIZE / 2 && y > CELL_SIZE / 4) || (y == CELL_SIZE / 2 && x > CELL_SIZE / 4))
+            if ((x == cell_size / 2 && y > cell_size / 4) || (y == cell_size / 2 && x > cell_size / 4))
             {
                 r = (uint8_t)(r * 0.4f);
                 g = (uint8_t)(g * 0.4f);
                 b = (uint8_t)(b * 0.4f);
             }
             // Occasional extra crack
-            if ((x == y && x > 3 && x < CELL_SIZE - 3))
+            if ((x == y && x > 3 && x < cell_size - 3))
             {
                 r = (uint8_t)(r * 0.5f);
                 g = (uint8_t)(g * 0.5f);
                 b = (uint8_t)(b * 0.5f);
             }
-            int draw_x = px + x;
-            int draw_y = py + y;
-            if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                video_buffer[draw_y * FB_WIDTH + draw_x] = (r << 16) | (g << 8) | b;
+            dst[y * cell_size + x] = (r << 16) | (g << 8) | b;
         }
     }
 }
 
-static void draw_obstacles(void)
+/* Draw obstacles on the grid. Obstacles are static for a whole game,
+ * so they are drawn into the static background layer rather than
+ * onto every frame. */
+static void draw_obstacle_pixelart(const surface_t *s, int cx, int cy)
 {
-    for (int x = 0; x < GRID_W; x++)
-    {
-        for (int y = 0; y < GRID_H; y++)
-        {
-            if (obstacle[x][y])
-            {
-                draw_obstacle_pixelart(x, y);
-            }
-        }
-    }
+    int id = SPRITE_OBSTACLE + (cx * 13 + cy * 7) % OBSTACLE_VARIANTS;
+    sprite_bake(id);
+    draw_sprite_to(s, id, cx, cy);
 }
 
-/* Update snake with obstacle collision detection */
-static void update_snake(void)
+static void draw_obstacles(const surface_t *s)
 {
-    /* Apply pending direction at the start of the move. */
-    snake_dir = pending_dir;
-    /* Compute new head position based on direction. */
-    int new_x = snake_x[0];
-    int new_y = snake_y[0];
-    switch (snake_dir)
-    {
-    case DIR_UP:
-        new_y--;
-        break;
-    case DIR_DOWN:
-        new_y++;
-        break;
-    case DIR_LEFT:
-        new_x--;
-        break;
-    case DIR_RIGHT:
-        new_x++;
-        break;
-    }
-
-    /* Check wall collisions. If the snake hits a wall and phasing is
-     * inactive the game is over. With phasing active we simply wrap
-     * around to the other side. */
-    bool wrap = (phase_timer > 0);
-    if (wrap)
-    {
-        if (new_x < 0)
-            new_x = GRID_W - 1;
-        if (new_x >= GRID_W)
-            new_x = 0;
-        if (new_y < 0)
-            new_y = GRID_H - 1;
-        if (new_y >= GRID_H)
-            new_y = 0;
-    }
-    else
-    {
-        if (new_x < 0 || new_x >= GRID_W || new_y < 0 || new_y >= GRID_H)
-        {
-            state = STATE_GAMEOVER;
-            return;
-        }
-    }
-
-    /* Check self collision. With phasing active we ignore collisions
-     * with the body. */
-    if (phase_timer <= 0)
+    for (int x = 0; x < grid_w; x++)
     {
-        for (int i = 0; i < snake_length; i++)
+        for (int y = 0; y < grid_h; y++)
         {
-            if (snake_x[i] == new_x && snake_y[i] == new_y)
+            if (snek_sim_obstacle_at(&sim, x, y))
             {
-                state = STATE_GAMEOVER;
-                return;
+                draw_obstacle_pixelart(s, x, y);
             }
         }
     }
+}
 
-    /* Check for obstacle collision */
-    if (check_obstacle_collision(new_x, new_y))
-    {
-        state = STATE_GAMEOVER;
-        return;
-    }
-
-    /* Move body: shift positions down the array. We iterate from
-     * tail to head so we don’t overwrite data. */
-    for (int i = snake_length - 1; i > 0; i--)
-    {
-        snake_x[i] = snake_x[i - 1];
-        snake_y[i] = snake_y[i - 1];
-    }
-    snake_x[0] = new_x;
-    snake_y[0] = new_y;
-
-    /* Check fruit collision. If we eat food we grow by one segment. */
-    if (new_x == food_x && new_y == food_y)
-    {
-        if (snake_length < MAX_SNAKE_LENGTH)
-        {
-            snake_length++;
-            snake_x[snake_length - 1] = snake_x[snake_length - 2];
-            snake_y[snake_length - 1] = snake_y[snake_length - 2];
-        }
-        score += 10;
-        if (score > highscore)
-            highscore = score;
-        spawn_particles(food_x, food_y, FOOD_COLOUR);
-        spawn_food();
-        spawn_item();
-    }
-
-    /* Check item collision. Activate power‑up and remove item. */
-    if (item_type != ITEM_NONE && new_x == item_x && new_y == item_y)
+/* Poll the controller. Returns the pressed buttons, one bit per
+ * RETRO_DEVICE_ID_JOYPAD_*. */
+static unsigned read_input(void)
+{
+    static const unsigned ids[] = {RETRO_DEVICE_ID_JOYPAD_UP, RETRO_DEVICE_ID_JOYPAD_DOWN,
+                                   RETRO_DEVICE_ID_JOYPAD_LEFT, RETRO_DEVICE_ID_JOYPAD_RIGHT,
+                                   RETRO_DEVICE_ID_JOYPAD_START, RETRO_DEVICE_ID_JOYPAD_SELECT};
+    input_poll_cb();
+    unsigned buttons = 0;
+    for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
     {
-        if (item_type == ITEM_PHASE)
-        {
-            phase_timer = PHASE_DURATION;
-        }
-        else if (item_type == ITEM_SPEED)
-        {
-            speed_timer = SPEED_DURATION;
-        }
-        spawn_particles(item_x, item_y,
-                        (item_type == ITEM_PHASE ? PHASE_COLOUR : SPEED_COLOUR));
-        item_type = ITEM_NONE;
+        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, ids[i]))
+            buttons |= 1u << ids[i];
     }
+    return buttons;
 }
 
-/* Poll input and update direction or state accordingly. */
-static void handle_input(void)
+/* Act on the buttons of this frame, one bit per
+ * RETRO_DEVICE_ID_JOYPAD_*. */
+static void handle_input(unsigned buttons)
 {
-    input_poll_cb();
-    int up = input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP);
-    int down = input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN);
-    int left = input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT);
-    int right = input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT);
-    int start = input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START);
-    int select = input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_SELECT);
+    int up = (buttons >> RETRO_DEVICE_ID_JOYPAD_UP) & 1;
+    int down = (buttons >> RETRO_DEVICE_ID_JOYPAD_DOWN) & 1;
+    int left = (buttons >> RETRO_DEVICE_ID_JOYPAD_LEFT) & 1;
+    int right = (buttons >> RETRO_DEVICE_ID_JOYPAD_RIGHT) & 1;
+    int start = (buttons >> RETRO_DEVICE_ID_JOYPAD_START) & 1;
+    int select = (buttons >> RETRO_DEVICE_ID_JOYPAD_SELECT) & 1;
 
     /* Toggle pause when pressing Start. In title screen, pressing
      * Start begins the game. After game over pressing Start resets
      * and begins a new game. */
-    static int prev_start = 0;
     if (start && !prev_start)
     {
         if (state == STATE_TITLE)
@@ -687,81 +857,28 @@ static void handle_input(void)
     prev_start = start;
 
     /* Reset the highscore with Select if on the title screen. */
-    static int prev_select = 0;
     if (select && !prev_select)
     {
         if (state == STATE_TITLE)
         {
-            highscore = 0;
+            sim.highscore = 0;
         }
     }
     prev_select = select;
 
-    /* Only allow turning when in play state. The snake cannot
-     * reverse direction. Only update pending_dir, not snake_dir. */
-    if (state == STATE_PLAY)
-    {
-        if (up && snake_dir != DIR_DOWN && pending_dir != DIR_DOWN)
-            pending_dir = DIR_UP;
-        else if (down && snake_dir != DIR_UP && pending_dir != DIR_UP)
-            pending_dir = DIR_DOWN;
-        else if (left && snake_dir != DIR_RIGHT && pending_dir != DIR_RIGHT)
-            pending_dir = DIR_LEFT;
-        else if (right && snake_dir != DIR_LEFT && pending_dir != DIR_LEFT)
-            pending_dir = DIR_RIGHT;
-    }
-}
-
-/* Draw a 3D‑shaded square representing a cell. When shaded==true
- * the cell interior is filled with the supplied colour and the
- * edges are lightened/darkened to produce a beveled effect. When
- * shaded==false the cell is drawn solid with the given colour. */
-static void draw_cell(int cx, int cy, colour_t colour, bool shaded)
-{
-    int px = cx * CELL_SIZE;
-    int py = cy * CELL_SIZE;
-    for (int y = 0; y < CELL_SIZE; y++)
+    /* Every newly pressed direction is a turn, queued by the game so
+     * that quick double turns between two moves are all taken. One the
+     * snake cannot take yet, or pressed outside of play, is tried again
+     * for as long as it is held. */
+    unsigned dirs = (unsigned)(up << SNEK_DIR_UP | down << SNEK_DIR_DOWN | left << SNEK_DIR_LEFT |
+                               right << SNEK_DIR_RIGHT);
+    unsigned want = (dirs & ~prev_dirs) | (retry_dirs & dirs);
+    prev_dirs = dirs;
+    retry_dirs = 0;
+    for (int d = SNEK_DIR_UP; d <= SNEK_DIR_RIGHT; d++)
     {
-        for (int x = 0; x < CELL_SIZE; x++)
-        {
-            float fx = (float)x / (float)CELL_SIZE;
-            float fy = (float)y / (float)CELL_SIZE;
-            colour_t col = colour;
-            if (shaded)
-            {
-                /* Lighten top/left edges and darken bottom/right edges. */
-                float shade = 0.0f;
-                if (fx < 0.1f || fy < 0.1f)
-                    shade = 0.2f;
-                else if (fx > 0.9f || fy > 0.9f)
-                    shade = -0.2f;
-                uint8_t r = (col >> 16) & 0xFF;
-                uint8_t g = (col >> 8) & 0xFF;
-                uint8_t b = col & 0xFF;
-                int ir = (int)r + (int)(shade * 255.f);
-                int ig = (int)g + (int)(shade * 255.f);
-                int ib = (int)b + (int)(shade * 255.f);
-                if (ir < 0)
-                    ir = 0;
-                if (ir > 255)
-                    ir = 255;
-                if (ig < 0)
-                    ig = 0;
-                if (ig > 255)
-                    ig = 255;
-                if (ib < 0)
-                    ib = 0;
-                if (ib > 255)
-                    ib = 255;
-                col = (ir << 16) | (ig << 8) | ib;
-            }
-            int draw_x = px + x;
-            int draw_y = py + y;
-            if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-            {
-                video_buffer[draw_y * FB_WIDTH + draw_x] = col;
-            }
-        }
+        if (((want >> d) & 1) && (state != STATE_PLAY || !snek_sim_turn(&sim, (snek_dir_t)d)))
+            retry_dirs |= 1u << d;
     }
 }
 
@@ -770,21 +887,23 @@ static void draw_cell(int cx, int cy, colour_t colour, bool shaded)
  * gradient effect. During phasing the snake is tinted with the
  * phasing colour. */
 // Fancy pixel art for snake head
-static void draw_snake_head(int cx, int cy, direction_t dir, colour_t base, bool phasing)
+static void bake_head_sprite(colour_t *dst, snek_dir_t dir, colour_t base, bool phasing)
 {
-    int px = cx * CELL_SIZE;
-    int py = cy * CELL_SIZE;
+    int px = 0;
+    int py = 0;
+    for (int i = 0; i < SPRITE_PIXELS; i++)
+        dst[i] = SPRITE_KEY;
     // Draw a rounded head with a highlight and a mouth
-    for (int y = 0; y < CELL_SIZE; y++)
+    for (int y = 0; y < cell_size; y++)
     {
-        for (int x = 0; x < CELL_SIZE; x++)
+        for (int x = 0; x < cell_size; x++)
         {
             // Circle mask for head
-            int dx = x - CELL_SIZE / 2;
-            int dy = y - CELL_SIZE / 2;
-            if (dx * dx + dy * dy < (CELL_SIZE / 2) * (CELL_SIZE / 2))
+            int dx = x - cell_size / 2;
+            int dy = y - cell_size / 2;
+            if (dx * dx + dy * dy < (cell_size / 2) * (cell_size / 2))
             {
-                float t = 0.7f + 0.3f * (float)(CELL_SIZE / 2 - dy) / (CELL_SIZE / 2); // vertical gradient
+                float t = 0.7f + 0.3f * (float)(cell_size / 2 - dy) / (cell_size / 2); // vertical gradient
                 uint8_t r = (base >> 16) & 0xFF;
                 uint8_t g = (base >> 8) & 0xFF;
                 uint8_t b = base & 0xFF;
@@ -793,15 +912,12 @@ static void draw_snake_head(int cx, int cy, direction_t dir, colour_t base, bool
                 b = (uint8_t)(b * t);
                 colour_t col = (r << 16) | (g << 8) | b;
                 // Highlight
-                if (x < CELL_SIZE / 2 && y < CELL_SIZE / 2 && dx * dx + dy * dy < (CELL_SIZE / 2 - 2) * (CELL_SIZE / 2 - 2))
+                if (x < cell_size / 2 && y < cell_size / 2 && dx * dx + dy * dy < (cell_size / 2 - 2) * (cell_size / 2 - 2))
                     col = lerp_colour(col, RGB(255, 255, 255), 0.15f);
                 // Phasing tint (keep for visual effect, but now color is handled in draw_snake)
                 if (phasing)
                     col = lerp_colour(col, PHASE_COLOUR, 0.2f);
-                int draw_x = px + x;
-                int draw_y = py + y;
-                if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                    video_buffer[draw_y * FB_WIDTH + draw_x] = col;
+                dst[y * cell_size + x] = col;
             }
         }
     }
@@ -809,103 +925,162 @@ static void draw_snake_head(int cx, int cy, direction_t dir, colour_t base, bool
     int ex1, ey1, ex2, ey2;
     switch (dir)
     {
-    case DIR_UP:
-        ex1 = px + CELL_SIZE / 3;
-        ey1 = py + CELL_SIZE / 4;
-        ex2 = px + 2 * CELL_SIZE / 3;
-        ey2 = py + CELL_SIZE / 4;
+    case SNEK_DIR_UP:
+        ex1 = px + cell_size / 3;
+        ey1 = py + cell_size / 4;
+        ex2 = px + 2 * cell_size / 3;
+        ey2 = py + cell_size / 4;
         break;
-    case DIR_DOWN:
-        ex1 = px + CELL_SIZE / 3;
-        ey1 = py + 3 * CELL_SIZE / 4;
-        ex2 = px + 2 * CELL_SIZE / 3;
-        ey2 = py + 3 * CELL_SIZE / 4;
+    case SNEK_DIR_DOWN:
+        ex1 = px + cell_size / 3;
+        ey1 = py + 3 * cell_size / 4;
+        ex2 = px + 2 * cell_size / 3;
+        ey2 = py + 3 * cell_size / 4;
         break;
-    case DIR_LEFT:
-        ex1 = px + CELL_SIZE / 4;
-        ey1 = py + CELL_SIZE / 3;
-        ex2 = px + CELL_SIZE / 4;
-        ey2 = py + 2 * CELL_SIZE / 3;
+    case SNEK_DIR_LEFT:
+        ex1 = px + cell_size / 4;
+        ey1 = py + cell_size / 3;
+        ex2 = px + cell_size / 4;
+        ey2 = py + 2 * cell_size / 3;
         break;
-    case DIR_RIGHT:
+    case SNEK_DIR_RIGHT:
     default:
-        ex1 = px + 3 * CELL_SIZE / 4;
-        ey1 = py + CELL_SIZE / 3;
-        ex2 = px + 3 * CELL_SIZE / 4;
-        ey2 = py + 2 * CELL_SIZE / 3;
+        ex1 = px + 3 * cell_size / 4;
+        ey1 = py + cell_size / 3;
+        ex2 = px + 3 * cell_size / 4;
+        ey2 = py + 2 * cell_size / 3;
         break;
     }
     for (int dy = 0; dy < 3; dy++)
     {
         for (int dx = 0; dx < 3; dx++)
         {
-            int draw1_x = ex1 + dx - 1;
-            int draw1_y = ey1 + dy - 1;
-            int draw2_x = ex2 + dx - 1;
-            int draw2_y = ey2 + dy - 1;
-            if (draw1_x >= 0 && draw1_x < FB_WIDTH && draw1_y >= 0 && draw1_y < FB_HEIGHT)
-                video_buffer[draw1_y * FB_WIDTH + draw1_x] = RGB(0, 0, 0);
-            if (draw2_x >= 0 && draw2_x < FB_WIDTH && draw2_y >= 0 && draw2_y < FB_HEIGHT)
-                video_buffer[draw2_y * FB_WIDTH + draw2_x] = RGB(0, 0, 0);
+            dst[(ey1 + dy - 1) * cell_size + ex1 + dx - 1] = RGB(0, 0, 0);
+            dst[(ey2 + dy - 1) * cell_size + ex2 + dx - 1] = RGB(0, 0, 0);
         }
     }
     // Mouth (small arc)
-    int mx = px + CELL_SIZE / 2;
-    int my = py + CELL_SIZE / 2 + 3;
+    int mx = px + cell_size / 2;
+    int my = py + cell_size / 2 + 3;
     for (int i = -2; i <= 2; i++)
+        dst[(my + (i * i) / 6) * cell_size + mx + i] = RGB(60, 30, 0);
+}
+
+static int head_sprite_id(snek_dir_t dir, colour_t base, bool phasing)
+{
+    for (size_t c = 0; c < HEAD_COLOURS; c++)
     {
-        int draw_x = mx + i;
-        int draw_y = my + (i * i) / 6;
-        if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-            video_buffer[draw_y * FB_WIDTH + draw_x] = RGB(60, 30, 0);
+        if (*head_colours[c] == base)
+            return SPRITE_HEAD + (int)((c * 2 + (phasing ? 1 : 0)) * 4 + dir);
     }
+    return -1;
+}
+
+static void draw_snake_head(const surface_t *s, int cx, int cy, snek_dir_t dir, colour_t base, bool phasing)
+{
+    int id = head_sprite_id(dir, base, phasing);
+    if (id >= 0)
+        draw_sprite_to(s, id, cx, cy);
 }
 
 // Fancy pixel art for snake body segment (scales/stripes)
-static void draw_snake_body(int cx, int cy, colour_t base, float t, bool phasing)
+static void bake_body_classes(uint8_t *dst)
 {
-    int px = cx * CELL_SIZE;
-    int py = cy * CELL_SIZE;
-    for (int y = 0; y < CELL_SIZE; y++)
+    for (int y = 0; y < cell_size; y++)
     {
-        for (int x = 0; x < CELL_SIZE; x++)
+        for (int x = 0; x < cell_size; x++)
         {
+            uint8_t cls = BODY_CLASS_NONE;
             // Elliptical mask for body
-            int dx = x - CELL_SIZE / 2;
-            int dy = y - CELL_SIZE / 2;
-            if ((dx * dx) * 3 / 4 + dy * dy < (CELL_SIZE / 2) * (CELL_SIZE / 2))
+            int dx = x - cell_size / 2;
+            int dy = y - cell_size / 2;
+            if ((dx * dx) * 3 / 4 + dy * dy < (cell_size / 2) * (cell_size / 2))
             {
-                float darken = 0.7f + 0.3f * (1.0f - t);
-                uint8_t r = (base >> 16) & 0xFF;
-                uint8_t g = (base >> 8) & 0xFF;
-                uint8_t b = base & 0xFF;
-                r = (uint8_t)(r * darken);
-                g = (uint8_t)(g * darken);
-                b = (uint8_t)(b * darken);
-                colour_t col = (r << 16) | (g << 8) | b;
-                // Add stripes
-                if ((y % 4 == 0) && (x > 2 && x < CELL_SIZE - 2))
-                    col = lerp_colour(col, RGB(40, 120, 40), 0.3f);
-                // Add scale dots
-                if ((x + y) % 7 == 0)
-                    col = lerp_colour(col, RGB(200, 255, 200), 0.1f);
-                // Phasing tint (keep for visual effect, but now color is handled in draw_snake)
-                if (phasing)
-                    col = lerp_colour(col, PHASE_COLOUR, 0.2f);
-                int draw_x = px + x;
-                int draw_y = py + y;
-                if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                    video_buffer[draw_y * FB_WIDTH + draw_x] = col;
+                bool stripe = (y % 4 == 0) && (x > 2 && x < cell_size - 2);
+                bool dot = (x + y) % 7 == 0;
+                if (stripe && dot)
+                    cls = BODY_CLASS_STRIPE_DOT;
+                else if (stripe)
+                    cls = BODY_CLASS_STRIPE;
+                else if (dot)
+                    cls = BODY_CLASS_DOT;
+                else
+                    cls = BODY_CLASS_PLAIN;
+            }
+            dst[y * cell_size + x] = cls;
+        }
+    }
+}
+
+/* Plain body colour of a segment t along the snake (0 at the head, 1
+ * at the tail), darkening towards the tail. */
+static colour_t body_colour(colour_t base, float t)
+{
+    float darken = 0.7f + 0.3f * (1.0f - t);
+    uint8_t r = (base >> 16) & 0xFF;
+    uint8_t g = (base >> 8) & 0xFF;
+    uint8_t b = base & 0xFF;
+    r = (uint8_t)(r * darken);
+    g = (uint8_t)(g * darken);
+    b = (uint8_t)(b * darken);
+    return (r << 16) | (g << 8) | b;
+}
+
+static void draw_snake_body(const surface_t *s, int cx, int cy, colour_t base, float t, bool phasing)
+{
+    if (cx < 0 || cx >= grid_w || cy < 0 || cy >= grid_h)
+        return;
+    /* Resolve the shading classes for this segment. */
+    colour_t col = body_colour(base, t);
+    // Add stripes
+    colour_t striped = lerp_colour(col, BODY_STRIPE_COLOUR, BODY_STRIPE_MIX);
+    colour_t palette[BODY_CLASS_COUNT];
+    palette[BODY_CLASS_NONE] = 0;
+    palette[BODY_CLASS_PLAIN] = col;
+    palette[BODY_CLASS_STRIPE] = striped;
+    // Add scale dots
+    palette[BODY_CLASS_DOT] = lerp_colour(col, BODY_DOT_COLOUR, BODY_DOT_MIX);
+    palette[BODY_CLASS_STRIPE_DOT] = lerp_colour(striped, BODY_DOT_COLOUR, BODY_DOT_MIX);
+    // Phasing tint (keep for visual effect, but now color is handled in draw_snake)
+    if (phasing)
+    {
+        for (int i = BODY_CLASS_PLAIN; i < BODY_CLASS_COUNT; i++)
+            palette[i] = lerp_colour(palette[i], PHASE_COLOUR, BODY_PHASE_MIX);
+    }
+    for (int i = 0; i < BODY_CLASS_COUNT; i++)
+        palette[i] = native_colour(palette[i]);
+    int x0, y0, x1, y1;
+    if (!cell_clip(s, cx, cy, &x0, &y0, &x1, &y1))
+        return;
+    const uint8_t *src = body_classes + y0 * cell_size;
+    for (int y = y0; y < y1; y++, src += cell_size)
+    {
+        uint8_t *dst = surface_pixel(s, cx * cell_size, cy * cell_size + y);
+        for (int n = 0; n < body_runs.run_count[y]; n++)
+        {
+            const sprite_run_t *run = &body_runs.runs[y][n];
+            int start = run->start > x0 ? run->start : x0;
+            int end = run->start + run->len < x1 ? run->start + run->len : x1;
+            if (s->format == SURFACE_RGB565)
+            {
+                for (int x = start; x < end; x++)
+                    ((uint16_t *)dst)[x] = (uint16_t)palette[src[x]];
+            }
+            else
+            {
+                for (int x = start; x < end; x++)
+                    ((uint32_t *)dst)[x] = palette[src[x]];
             }
         }
     }
 }
 
-static void draw_snake(void)
+/* Work out the head and body colours for the current power‑up
+ * state. An expiring effect blinks back to the default colours. */
+static void snake_colours(colour_t *head, colour_t *body)
 {
-    // Determine active powerup and color
-    bool phasing = (phase_timer > 0);
-    bool speeding = (speed_timer > 0);
+    bool phasing = (sim.phase_timer > 0);
+    bool speeding = (sim.speed_timer > 0);
     int blink_frames = 60; // 1 second at 60Hz
     bool blink = false;
     colour_t powerup_head = SNAKE_HEAD_COLOUR;
@@ -914,7 +1089,7 @@ static void draw_snake(void)
     {
         powerup_head = PHASE_COLOUR;
         powerup_body = PHASE_COLOUR;
-        if (phase_timer <= blink_frames && (frame_count / 6) % 2 == 0)
+        if (sim.phase_timer <= blink_frames && (frame_count / 6) % 2 == 0)
         {
             blink = true;
         }
@@ -923,47 +1098,74 @@ static void draw_snake(void)
     {
         powerup_head = SPEED_COLOUR;
         powerup_body = SPEED_COLOUR;
-        if (speed_timer <= blink_frames && (frame_count / 6) % 2 == 0)
+        if (sim.speed_timer <= blink_frames && (frame_count / 6) % 2 == 0)
         {
             blink = true;
         }
     }
-    for (int i = 0; i < snake_length; i++)
+    // Blink to default color if effect is expiring
+    if (blink)
     {
-        float t = (snake_length > 1) ? (float)i / (float)(snake_length - 1) : 0.f;
-        colour_t base = (i == 0) ? powerup_head : powerup_body;
-        // Blink to default color if effect is expiring
-        if (blink)
-        {
-            base = (i == 0) ? SNAKE_HEAD_COLOUR : SNAKE_BODY_COLOUR;
-        }
-        if (i == 0)
-        {
-            draw_snake_head(snake_x[i], snake_y[i], snake_dir, base, phasing);
-        }
-        else
-        {
-            draw_snake_body(snake_x[i], snake_y[i], base, t, phasing);
-        }
+        powerup_head = SNAKE_HEAD_COLOUR;
+        powerup_body = SNAKE_BODY_COLOUR;
+    }
+    *head = powerup_head;
+    *body = powerup_body;
+}
+
+/* True if the cell is covered by an obstacle. Obstacles are part of
+ * the background layer but conceptually drawn on top of everything
+ * else, so nothing may be drawn over them. */
+static bool cell_hidden(int cx, int cy)
+{
+    return snek_sim_obstacle_at(&sim, cx, cy);
+}
+
+/* Draw segment i of the snake using precomputed colours. */
+static void draw_snake_segment(const surface_t *s, int i, colour_t head, colour_t body, bool phasing)
+{
+    int x = snek_sim_seg_x(&sim, i);
+    int y = snek_sim_seg_y(&sim, i);
+    if (cell_hidden(x, y))
+        return;
+    if (i == 0)
+    {
+        draw_snake_head(s, x, y, sim.dir, head, phasing);
+    }
+    else
+    {
+        float t = (sim.length > 1) ? (float)i / (float)(sim.length - 1) : 0.f;
+        draw_snake_body(s, x, y, body, t, phasing);
     }
 }
 
+static void draw_snake(const surface_t *s)
+{
+    colour_t head, body;
+    snake_colours(&head, &body);
+    bool phasing = (sim.phase_timer > 0);
+    for (int i = 0; i < sim.length; i++)
+        draw_snake_segment(s, i, head, body, phasing);
+}
+
 /* Draw the fruit as a filled square with shading. */
 // Fancy pixel art for food (shiny apple)
-static void draw_food(void)
+static void bake_food_sprite(colour_t *dst)
 {
-    int px = food_x * CELL_SIZE;
-    int py = food_y * CELL_SIZE;
+    int px = 0;
+    int py = 0;
+    for (int i = 0; i < SPRITE_PIXELS; i++)
+        dst[i] = SPRITE_KEY;
     // Apple body
-    for (int y = 0; y < CELL_SIZE; y++)
+    for (int y = 0; y < cell_size; y++)
     {
-        for (int x = 0; x < CELL_SIZE; x++)
+        for (int x = 0; x < cell_size; x++)
         {
-            int dx = x - CELL_SIZE / 2;
-            int dy = y - CELL_SIZE / 2 + 2;
-            if (dx * dx + dy * dy < (CELL_SIZE / 2 - 1) * (CELL_SIZE / 2 - 1))
+            int dx = x - cell_size / 2;
+            int dy = y - cell_size / 2 + 2;
+            if (dx * dx + dy * dy < (cell_size / 2 - 1) * (cell_size / 2 - 1))
             {
-                float t = 0.8f + 0.2f * (float)(CELL_SIZE / 2 - dy) / (CELL_SIZE / 2);
+                float t = 0.8f + 0.2f * (float)(cell_size / 2 - dy) / (cell_size / 2);
                 uint8_t r = (FOOD_COLOUR >> 16) & 0xFF;
                 uint8_t g = (FOOD_COLOUR >> 8) & 0xFF;
                 uint8_t b = FOOD_COLOUR & 0xFF;
@@ -972,58 +1174,49 @@ static void draw_food(void)
                 b = (uint8_t)(b * t * 0.9f);
                 colour_t col = (r << 16) | (g << 8) | b;
                 // Highlight
-                if (x < CELL_SIZE / 2 && y < CELL_SIZE / 2 && dx * dx + dy * dy < (CELL_SIZE / 2 - 3) * (CELL_SIZE / 2 - 3))
+                if (x < cell_size / 2 && y < cell_size / 2 && dx * dx + dy * dy < (cell_size / 2 - 3) * (cell_size / 2 - 3))
                     col = lerp_colour(col, RGB(255, 255, 255), 0.18f);
-                int draw_x = px + x;
-                int draw_y = py + y;
-                if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                    video_buffer[draw_y * FB_WIDTH + draw_x] = col;
+                dst[y * cell_size + x] = col;
             }
         }
     }
     // Apple stem
     for (int y = 0; y < 3; y++)
-    {
-        int draw_x = px + CELL_SIZE / 2;
-        int draw_y = py + y + 2;
-        if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-            video_buffer[draw_y * FB_WIDTH + draw_x] = RGB(80, 40, 0);
-    }
+        dst[(py + y + 2) * cell_size + px + cell_size / 2] = RGB(80, 40, 0);
     // Apple leaf
     for (int y = 0; y < 2; y++)
     {
         for (int x = 0; x < 3; x++)
-        {
-            int draw_x = px + CELL_SIZE / 2 - 2 + x;
-            int draw_y = py + 2 + y;
-            if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                video_buffer[draw_y * FB_WIDTH + draw_x] = RGB(40, 180, 40);
-        }
+            dst[(py + 2 + y) * cell_size + px + cell_size / 2 - 2 + x] = RGB(40, 180, 40);
     }
 }
 
+static void draw_food(const surface_t *s)
+{
+    if (!cell_hidden(sim.food_x, sim.food_y))
+        draw_sprite_to(s, SPRITE_FOOD, sim.food_x, sim.food_y);
+}
+
 /* Draw a power‑up icon. Phase is drawn as a diamond; speed as a
  * lightning bolt. */
 // Fancy pixel art for power-ups: gem diamond and stylized lightning bolt
-static void draw_item(void)
+static void bake_item_sprite(colour_t *dst, snek_item_t type)
 {
-    if (item_type == ITEM_NONE)
-        return;
-    int px = item_x * CELL_SIZE;
-    int py = item_y * CELL_SIZE;
-    if (item_type == ITEM_PHASE)
+    for (int i = 0; i < SPRITE_PIXELS; i++)
+        dst[i] = SPRITE_KEY;
+    if (type == SNEK_ITEM_PHASE)
     {
         // Gem-like diamond with facets and glow
-        for (int y = 0; y < CELL_SIZE; y++)
+        for (int y = 0; y < cell_size; y++)
         {
-            for (int x = 0; x < CELL_SIZE; x++)
+            for (int x = 0; x < cell_size; x++)
             {
-                int dx = x - CELL_SIZE / 2;
-                int dy = y - CELL_SIZE / 2;
+                int dx = x - cell_size / 2;
+                int dy = y - cell_size / 2;
                 float dist = fabsf(dx) + fabsf(dy) * 0.9f;
-                if (dist < CELL_SIZE / 2 - 1)
+                if (dist < cell_size / 2 - 1)
                 {
-                    float t = 0.7f + 0.3f * (float)(CELL_SIZE / 2 - dy) / (CELL_SIZE / 2);
+                    float t = 0.7f + 0.3f * (float)(cell_size / 2 - dy) / (cell_size / 2);
                     uint8_t r = (PHASE_COLOUR >> 16) & 0xFF;
                     uint8_t g = (PHASE_COLOUR >> 8) & 0xFF;
                     uint8_t b = PHASE_COLOUR & 0xFF;
@@ -1037,44 +1230,35 @@ static void draw_item(void)
                     // Central shine
                     if (dx * dx + dy * dy < 9)
                         col = lerp_colour(col, RGB(255, 255, 255), 0.25f);
-                    int draw_x = px + x;
-                    int draw_y = py + y;
-                    if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                        video_buffer[draw_y * FB_WIDTH + draw_x] = col;
+                    dst[y * cell_size + x] = col;
                 }
                 // Outer glow
-                else if (dist < CELL_SIZE / 2 + 1)
+                else if (dist < cell_size / 2 + 1)
                 {
-                    int draw_x = px + x;
-                    int draw_y = py + y;
-                    colour_t col = lerp_colour(PHASE_COLOUR, RGB(255, 255, 255), 0.2f);
-                    if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                        video_buffer[draw_y * FB_WIDTH + draw_x] = col;
+                    dst[y * cell_size + x] = lerp_colour(PHASE_COLOUR, RGB(255, 255, 255), 0.2f);
                 }
             }
         }
     }
-    else if (item_type == ITEM_SPEED)
+    else if (type == SNEK_ITEM_SPEED)
     {
         // Stylized lightning bolt with shading and glow
-        for (int y = 0; y < CELL_SIZE; y++)
+        for (int y = 0; y < cell_size; y++)
         {
-            for (int x = 0; x < CELL_SIZE; x++)
+            for (int x = 0; x < cell_size; x++)
             {
-                int draw_x = px + x;
-                int draw_y = py + y;
                 // Bolt shape: zig-zag
                 bool fill = false;
-                if (y > 2 && y < CELL_SIZE - 2)
+                if (y > 2 && y < cell_size - 2)
                 {
-                    int relx = x - CELL_SIZE / 2;
+                    int relx = x - cell_size / 2;
                     int rely = y - 2;
-                    if ((rely > 0 && rely < CELL_SIZE / 2 && relx > -2 && relx < 3 && relx > (rely / 3) - 2) || (rely >= CELL_SIZE / 2 && relx > 0 && relx < 5 && relx < (rely / 2) + 2))
+                    if ((rely > 0 && rely < cell_size / 2 && relx > -2 && relx < 3 && relx > (rely / 3) - 2) || (rely >= cell_size / 2 && relx > 0 && relx < 5 && relx < (rely / 2) + 2))
                         fill = true;
                 }
                 if (fill)
                 {
-                    float t = 0.8f + 0.2f * (float)y / (float)CELL_SIZE;
+                    float t = 0.8f + 0.2f * (float)y / (float)cell_size;
                     uint8_t r = (SPEED_COLOUR >> 16) & 0xFF;
                     uint8_t g = (SPEED_COLOUR >> 8) & 0xFF;
                     uint8_t b = SPEED_COLOUR & 0xFF;
@@ -1083,327 +1267,1790 @@ static void draw_item(void)
                     b = (uint8_t)(b * t);
                     colour_t col = (r << 16) | (g << 8) | b;
                     // Highlight
-                    if (x < CELL_SIZE / 2)
+                    if (x < cell_size / 2)
                         col = lerp_colour(col, RGB(255, 255, 180), 0.18f);
                     // Central shine
-                    if (x == CELL_SIZE / 2 || y == CELL_SIZE / 2)
+                    if (x == cell_size / 2 || y == cell_size / 2)
                         col = lerp_colour(col, RGB(255, 255, 255), 0.18f);
-                    if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                        video_buffer[draw_y * FB_WIDTH + draw_x] = col;
+                    dst[y * cell_size + x] = col;
                 }
                 // Glow
-                else if (y > 1 && y < CELL_SIZE - 1 && x > 1 && x < CELL_SIZE - 1)
+                else if (y > 1 && y < cell_size - 1 && x > 1 && x < cell_size - 1)
                 {
                     if ((x + y) % 7 == 0)
-                    {
-                        colour_t col = lerp_colour(SPEED_COLOUR, RGB(255, 255, 180), 0.12f);
-                        if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                            video_buffer[draw_y * FB_WIDTH + draw_x] = col;
-                    }
+                        dst[y * cell_size + x] = lerp_colour(SPEED_COLOUR, RGB(255, 255, 180), 0.12f);
                 }
             }
         }
     }
 }
 
-/* Draw a seven‑segment digit at the specified pixel position. The
- * digit occupies a 20×36 pixel area. */
-static void draw_segment(int x, int y, int px, int py, int pw, int ph, colour_t colour)
+static void draw_item(const surface_t *s)
+{
+    if (cell_hidden(sim.item_x, sim.item_y))
+        return;
+    if (sim.item_type == SNEK_ITEM_PHASE)
+        draw_sprite_to(s, SPRITE_ITEM_PHASE, sim.item_x, sim.item_y);
+    else if (sim.item_type == SNEK_ITEM_SPEED)
+        draw_sprite_to(s, SPRITE_ITEM_SPEED, sim.item_x, sim.item_y);
+}
+
+/* Render every sprite variant into the atlas at the current
+ * cell_size. Called again whenever the cell size changes. Returns
+ * false if memory runs out. */
+static bool sprites_init(void)
+{
+    free(sprite_atlas);
+    free(sprite_atlas565);
+    free(body_classes);
+    sprite_atlas = (colour_t *)malloc(SPRITE_COUNT * SPRITE_PIXELS * sizeof(colour_t));
+    sprite_atlas565 = (uint16_t *)malloc(SPRITE_COUNT * SPRITE_PIXELS * sizeof(uint16_t));
+    body_classes = (uint8_t *)malloc(SPRITE_PIXELS);
+    if (!sprite_atlas || !sprite_atlas565 || !body_classes)
+        return false;
+    memset(sprite_ready, 0, sizeof(sprite_ready));
+    bake_body_classes(body_classes);
+    sprite_build_runs(&body_runs, body_classes, class_is_opaque);
+#ifdef HAVE_OPENGL
+    hw_atlas_stale = true;
+#endif
+    return true;
+}
+
+/* Bake sprite id, unless it already is. Most frames use a handful of
+ * the sprites and many are never seen at all, so baking them as they
+ * are first needed keeps start-up and board changes cheap. */
+static void sprite_bake(int id)
 {
-    for (int yy = 0; yy < ph; yy++)
+    if (sprite_ready[id])
+        return;
+    colour_t *dst = sprite_atlas + id * SPRITE_PIXELS;
+    if (id < SPRITE_FOOD)
+        bake_obstacle_sprite(dst, id - SPRITE_OBSTACLE);
+    else if (id == SPRITE_FOOD)
+        bake_food_sprite(dst);
+    else if (id == SPRITE_ITEM_PHASE)
+        bake_item_sprite(dst, SNEK_ITEM_PHASE);
+    else if (id == SPRITE_ITEM_SPEED)
+        bake_item_sprite(dst, SNEK_ITEM_SPEED);
+    else
     {
-        for (int xx = 0; xx < pw; xx++)
-        {
-            int draw_x = x + px + xx;
-            int draw_y = y + py + yy;
-            if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-            {
-                video_buffer[draw_y * FB_WIDTH + draw_x] = colour;
-            }
-        }
+        /* See head_sprite_id(). */
+        int head = id - SPRITE_HEAD;
+        bake_head_sprite(dst, (snek_dir_t)(head % 4), *head_colours[head / 8], (head / 4) % 2 != 0);
     }
+    sprite_build_runs(&sprite_runs[id], dst, colour_is_opaque);
+    uint16_t *dst565 = sprite_atlas565 + id * SPRITE_PIXELS;
+    for (int i = 0; i < SPRITE_PIXELS; i++)
+        dst565[i] = rgb565_from_xrgb(dst[i]);
+    sprite_ready[id] = true;
 }
 
-static void draw_digit(int x, int y, int value, colour_t colour)
+/* Bake the sprites of everything on the board except the obstacles,
+ * which draw_obstacles() takes care of. Drawing only reads the atlas,
+ * so this runs before a frame is drawn, on the calling thread. */
+static void sprites_prepare(void)
 {
-    if (value < 0 || value > 9)
-        return;
-    uint8_t mask = seven_seg_digits[value];
-    /* Segment dimensions relative to digit area. */
-    int w = 20;
-    int h = 36;
-    int thickness = 4;
-    /* a: top horizontal */
-    if (mask & 0b1000000)
-        draw_segment(x, y, thickness, 0, w - 2 * thickness, thickness, colour);
-    /* b: upper right vertical */
-    if (mask & 0b0100000)
-        draw_segment(x, y, w - thickness, thickness, thickness, h / 2 - thickness, colour);
-    /* c: lower right vertical */
-    if (mask & 0b0010000)
-        draw_segment(x, y, w - thickness, h / 2, thickness, h / 2 - thickness, colour);
-    /* d: bottom horizontal */
-    if (mask & 0b0001000)
-        draw_segment(x, y, thickness, h - thickness, w - 2 * thickness, thickness, colour);
-    /* e: lower left vertical */
-    if (mask & 0b0000100)
-        draw_segment(x, y, 0, h / 2, thickness, h / 2 - thickness, colour);
-    /* f: upper left vertical */
-    if (mask & 0b0000010)
-        draw_segment(x, y, 0, thickness, thickness, h / 2 - thickness, colour);
-    /* g: middle horizontal */
-    if (mask & 0b0000001)
-        draw_segment(x, y, thickness, h / 2 - thickness / 2, w - 2 * thickness, thickness, colour);
+    colour_t head, body;
+    snake_colours(&head, &body);
+    int id = head_sprite_id(sim.dir, head, sim.phase_timer > 0);
+    if (id >= 0)
+        sprite_bake(id);
+    sprite_bake(SPRITE_FOOD);
+    if (sim.item_type == SNEK_ITEM_PHASE)
+        sprite_bake(SPRITE_ITEM_PHASE);
+    else if (sim.item_type == SNEK_ITEM_SPEED)
+        sprite_bake(SPRITE_ITEM_SPEED);
 }
 
-/* Draw a string using the 8×8 bitmap font. Each character occupies an
- * 8×8 block. The baseline is at y+8 (characters sit above this). */
-static void draw_text(int x, int y, const char *text, colour_t colour)
+static void sprites_deinit(void)
 {
-    for (const char *p = text; *p; ++p)
-    {
-        if (*p == ' ')
-        {
-            x += 8;
-            continue;
+    free(sprite_atlas);
+    free(sprite_atlas565);
+    free(body_classes);
+    sprite_atlas = NULL;
+    sprite_atlas565 = NULL;
+    body_classes = NULL;
+}
+
+/* ------------------------------------------------------------------
+ * HUD
+ *
+ * The scoreboard only changes when the score, the high score or the
+ * power‑up icons do, so it is rasterised into a canvas covering the
+ * HUD rows and reduced to a list of single colour runs per row.
+ * draw_scoreboard() just fills those runs; the canvas is rebuilt when
+ * the HUD look changes. Digits are stamped from seven‑segment tiles
+ * that are rasterised once in hud_init().
+ */
+#define DIGIT_W 20
+#define DIGIT_H 36
+#define HUD_TOP 8
+#define HUD_BOTTOM 68
+#define HUD_HEIGHT (HUD_BOTTOM - HUD_TOP)
+
+/* Everything that influences how the HUD looks. */
+typedef struct
+{
+    int score, highscore;
+    bool phasing, speeding;
+} hud_look_t;
+
+typedef struct
+{
+    uint16_t start, len;
+    colour_t colour;
+} hud_run_t;
+
+#define ICON_SIZE 12
+
+/* One bit per pixel of each digit, bit x set when column x is lit. */
+static uint32_t digit_tiles[10][DIGIT_H];
+/* Power‑up icons in the same format. */
+static uint32_t phase_icon[ICON_SIZE];
+static uint32_t speed_icon[ICON_SIZE];
+
+/* The canvas covers framebuffer rows HUD_TOP to HUD_BOTTOM. */
+static colour_t *hud_canvas = NULL;
+static surface_t hud_surface;
+static hud_run_t *hud_runs = NULL;
+static int hud_run_capacity = 0;
+static int hud_row_start[HUD_HEIGHT + 1];
+static hud_look_t hud_cached_look;
+static bool hud_cached = false;
+
+static void current_hud_look(hud_look_t *look)
+{
+    look->score = sim.score;
+    look->highscore = sim.highscore;
+    look->phasing = (sim.phase_timer > 0);
+    look->speeding = (sim.speed_timer > 0);
+}
+
+static bool hud_look_equal(const hud_look_t *a, const hud_look_t *b)
+{
+    return a->score == b->score && a->highscore == b->highscore &&
+           a->phasing == b->phasing && a->speeding == b->speeding;
+}
+
+/* Light a pw×ph block of a digit tile starting at (px, py). */
+static void digit_tile_segment(uint32_t *tile, int px, int py, int pw, int ph)
+{
+    for (int y = py; y < py + ph; y++)
+        tile[y] |= ((1u << pw) - 1u) << px;
+}
+
+static void hud_init(void)
+{
+    for (size_t i = 0; i < GLYPH_COUNT; i++)
+    {
+        for (int row = 0; row < 8; row++)
+        {
+            glyph_masks[i][row] = 0;
+            for (int col = 0; col < 8; col++)
+            {
+                if (font_glyphs[i].bitmap[row] & (1 << (7 - col)))
+                    glyph_masks[i][row] |= 1u << col;
+            }
         }
-        const uint8_t *bm = get_glyph_bitmap(*p);
-        if (bm)
+        glyph_table[(unsigned char)font_glyphs[i].ch] = glyph_masks[i];
+    }
+
+    /* Segment layout of a 20×36 digit. */
+    const int w = DIGIT_W;
+    const int h = DIGIT_H;
+    const int thickness = 4;
+    for (int value = 0; value < 10; value++)
+    {
+        uint32_t *tile = digit_tiles[value];
+        uint8_t mask = seven_seg_digits[value];
+        memset(tile, 0, sizeof(digit_tiles[value]));
+        /* a: top horizontal */
+        if (mask & 0b1000000)
+            digit_tile_segment(tile, thickness, 0, w - 2 * thickness, thickness);
+        /* b: upper right vertical */
+        if (mask & 0b0100000)
+            digit_tile_segment(tile, w - thickness, thickness, thickness, h / 2 - thickness);
+        /* c: lower right vertical */
+        if (mask & 0b0010000)
+            digit_tile_segment(tile, w - thickness, h / 2, thickness, h / 2 - thickness);
+        /* d: bottom horizontal */
+        if (mask & 0b0001000)
+            digit_tile_segment(tile, thickness, h - thickness, w - 2 * thickness, thickness);
+        /* e: lower left vertical */
+        if (mask & 0b0000100)
+            digit_tile_segment(tile, 0, h / 2, thickness, h / 2 - thickness);
+        /* f: upper left vertical */
+        if (mask & 0b0000010)
+            digit_tile_segment(tile, 0, thickness, thickness, h / 2 - thickness);
+        /* g: middle horizontal */
+        if (mask & 0b0000001)
+            digit_tile_segment(tile, thickness, h / 2 - thickness / 2, w - 2 * thickness, thickness);
+    }
+
+    /* Small diamond representing phasing, and a lightning bolt. */
+    for (int y = 0; y < ICON_SIZE; y++)
+    {
+        phase_icon[y] = 0;
+        speed_icon[y] = 0;
+        for (int x = 0; x < ICON_SIZE; x++)
         {
-            for (int row = 0; row < 8; row++)
+            if (abs(x - 6) + abs(y - 6) < 6)
+                phase_icon[y] |= 1u << x;
+            if ((y < 4 && x > 6) || (y >= 4 && y < 8 && x < 6) || (y >= 8 && x > 6))
+                speed_icon[y] |= 1u << x;
+        }
+    }
+
+}
+
+/* Size the canvas for the current framebuffer width. Returns false if
+ * memory runs out. */
+static bool hud_resize(void)
+{
+    free(hud_canvas);
+    hud_canvas = (colour_t *)malloc(HUD_HEIGHT * fb_width * sizeof(colour_t));
+    surface_init(&hud_surface, hud_canvas, SURFACE_XRGB8888, fb_width, HUD_HEIGHT, fb_width);
+    hud_cached = false;
+    return hud_canvas != NULL;
+}
+
+static void hud_deinit(void)
+{
+    free(hud_canvas);
+    hud_canvas = NULL;
+    free(hud_runs);
+    hud_runs = NULL;
+    hud_run_capacity = 0;
+    hud_cached = false;
+}
+
+/* Stamp a 1 bit mask onto the canvas; y is a framebuffer row. */
+static void hud_put_mask(int x, int y, const uint32_t *rows, int w, int h, colour_t colour)
+{
+    blit_masked(&hud_surface, x, y - HUD_TOP, rows, w, h, colour);
+}
+
+static void hud_put_text(int x, int y, const char *text, colour_t colour)
+{
+    for (const char *c = text; *c; ++c, x += 8)
+    {
+        const uint32_t *mask = get_glyph_mask(*c);
+        if (mask)
+            hud_put_mask(x, y, mask, 8, 8, colour);
+    }
+}
+
+/* Five digit number, least significant digit rightmost. */
+static void hud_put_number(int x, int y, int value, colour_t colour)
+{
+    for (int i = 0; i < 5; i++)
+    {
+        hud_put_mask(x + (4 - i) * 24, y, digit_tiles[value % 10], DIGIT_W, DIGIT_H, colour);
+        value /= 10;
+    }
+}
+
+/* Rasterise the scoreboard into the canvas, then collect its runs. The
+ * score appears on the left and the high score on the right. */
+static void hud_rebuild(const hud_look_t *look)
+{
+    blit_fill_rect(&hud_surface, 0, 0, fb_width, HUD_HEIGHT, SPRITE_KEY);
+
+    int base_y = 16;
+    hud_put_text(8, base_y, "SCORE", HUD_TEXT_COLOUR);
+    hud_put_number(8, 32, look->score, HUD_TEXT_COLOUR);
+    hud_put_text(fb_width - 8 - 2 * 8 - 5 * 24 - 4, base_y, "HI", HUD_TEXT_COLOUR);
+    hud_put_number(fb_width - 8 - 5 * 24, 32, look->highscore, HUD_TEXT_COLOUR);
+
+    /* Power‑up icons. */
+    int icon_y = 8;
+    int icon_x = fb_width / 2 - 32;
+    if (look->phasing)
+    {
+        hud_put_mask(icon_x, icon_y, phase_icon, ICON_SIZE, ICON_SIZE, PHASE_COLOUR);
+        icon_x += 16;
+    }
+    if (look->speeding)
+        hud_put_mask(icon_x, icon_y, speed_icon, ICON_SIZE, ICON_SIZE, SPEED_COLOUR);
+
+    int count = 0;
+    for (int y = 0; y < HUD_HEIGHT; y++)
+    {
+        const colour_t *row = hud_canvas + y * fb_width;
+        hud_row_start[y] = count;
+        int x = 0;
+        while (x < fb_width)
+        {
+            if (row[x] == SPRITE_KEY)
             {
-                uint8_t bits = bm[row];
-                for (int col = 0; col < 8; col++)
-                {
-                    if (bits & (1 << (7 - col)))
-                    {
-                        int px = x + col;
-                        int py = y + row;
-                        if (px >= 0 && px < FB_WIDTH && py >= 0 && py < FB_HEIGHT)
-                        {
-                            video_buffer[py * FB_WIDTH + px] = colour;
-                        }
-                    }
-                }
+                x++;
+                continue;
+            }
+            int start = x;
+            while (x < fb_width && row[x] == row[start])
+                x++;
+            if (count == hud_run_capacity)
+            {
+                int capacity = hud_run_capacity ? hud_run_capacity * 2 : 1024;
+                hud_run_t *runs = (hud_run_t *)realloc(hud_runs, capacity * sizeof(hud_run_t));
+                if (!runs)
+                    break;
+                hud_runs = runs;
+                hud_run_capacity = capacity;
+            }
+            hud_runs[count].start = (uint16_t)start;
+            hud_runs[count].len = (uint16_t)(x - start);
+            hud_runs[count].colour = native_colour(row[start]);
+            count++;
+        }
+    }
+    hud_row_start[HUD_HEIGHT] = count;
+    hud_cached_look = *look;
+    hud_cached = true;
+}
+
+/* Rebuild the cached scoreboard runs if the score or colours changed. */
+static void hud_update(void)
+{
+    hud_look_t look;
+    current_hud_look(&look);
+    if (!hud_cached || !hud_look_equal(&look, &hud_cached_look))
+        hud_rebuild(&look);
+}
+
+/* Draw the scoreboard at the top of the screen from the cached runs. */
+static void draw_scoreboard(const surface_t *s)
+{
+    hud_update();
+    for (int y = 0; y < HUD_HEIGHT; y++)
+    {
+        for (int r = hud_row_start[y]; r < hud_row_start[y + 1]; r++)
+        {
+            const hud_run_t *run = &hud_runs[r];
+            blit_plot_run(s, run->start, HUD_TOP + y, run->len, run->colour);
+        }
+    }
+}
+
+/* Draw a string using the 8×8 bitmap font. Each character occupies an
+ * 8×8 block. The baseline is at y+8 (characters sit above this). For
+ * this and dim_screen(), a NULL surface queues onto the hardware
+ * batch instead. */
+static void draw_text(const surface_t *s, int x, int y, const char *text, colour_t colour)
+{
+    for (const char *p = text; *p; ++p, x += 8)
+    {
+        const uint32_t *mask = get_glyph_mask(*p);
+        if (!mask)
+            continue;
+#ifdef HAVE_OPENGL
+        if (!s)
+        {
+            int glyph = (int)((mask - glyph_masks[0]) / 8);
+            gl_render_sprite(x, y, 8, 8, 0, HW_ATLAS_GLYPH_Y + glyph * 8, colour);
+            continue;
+        }
+#endif
+        blit_masked(s, x, y, mask, 8, 8, native_colour(colour));
+    }
+}
+
+/* Darken the whole picture for the overlays. */
+static void dim_screen(const surface_t *s)
+{
+#ifdef HAVE_OPENGL
+    if (!s)
+    {
+        gl_render_fill(0, 0, fb_width, fb_height, 1, HW_ATLAS_TEXEL_Y, 0);
+        return;
+    }
+#endif
+    blit_scale(s, PX_FACTOR(2, 5));
+}
+
+/* Draw the semi‑transparent game over overlay. Darkens the screen
+ * slightly and prints a message in the centre. */
+static void draw_gameover_overlay(const surface_t *s)
+{
+    /* Darken background by blending with black. */
+    dim_screen(s);
+    /* Draw "GAME OVER" text centred. */
+    const char *msg = "GAME OVER";
+    int msg_len = (int)strlen(msg);
+    int px = (fb_width - msg_len * 8) / 2;
+    int py = fb_height / 2 - 20;
+    draw_text(s, px, py, msg, GAMEOVER_COLOUR);
+    const char *ins = "PRESS START";
+    int ins_len = (int)strlen(ins);
+    px = (fb_width - ins_len * 8) / 2;
+    py += 20;
+    draw_text(s, px, py, ins, HUD_TEXT_COLOUR);
+}
+
+/* Pixel position of particle i as drawn. Between ticks it is moved on
+ * along its velocity, to where the next tick will put it. */
+static inline void particle_pos(int i, int *px, int *py)
+{
+    if (!tick_fraction)
+    {
+        *px = particles.x[i] >> 16;
+        *py = particles.y[i] >> 16;
+        return;
+    }
+    *px = (particles.x[i] + (int32_t)(((int64_t)particles.vx[i] * tick_fraction) >> 16)) >> 16;
+    *py = (particles.y[i] + (int32_t)(((int64_t)particles.vy[i] * tick_fraction) >> 16)) >> 16;
+}
+
+/* Returns true and the cell under particle i if it is on screen. */
+static bool particle_cell(int i, int *cx, int *cy)
+{
+    int px, py;
+    particle_pos(i, &px, &py);
+    if (px < 0 || px >= fb_width || py < 0 || py >= fb_height)
+        return false;
+    *cx = px / cell_size;
+    *cy = py / cell_size;
+    return true;
+}
+
+/* Static background layer: the vertical gradient with the obstacles
+ * composited on top. The gradient never changes, so its row colours
+ * are computed once; the layer itself is rebuilt only when the
+ * obstacle layout changes. */
+static void *background_buffer = NULL;
+static surface_t background;
+static colour_t *background_rows = NULL;
+static unsigned background_generation = 0;
+static bool background_valid = false;
+
+static bool background_init(void)
+{
+    free(background_rows);
+    background_rows = (colour_t *)malloc(fb_height * sizeof(colour_t));
+    if (!background_rows)
+        return false;
+    for (int y = 0; y < fb_height; y++)
+    {
+        float t = (float)y / (float)fb_height;
+        background_rows[y] = lerp_colour(BG_COLOUR_TOP, BG_COLOUR_BOTTOM, t);
+    }
+    background_valid = false;
+    return true;
+}
+
+/* Rebuild the background layer if the obstacles changed. Returns true
+ * when it was rebuilt, in which case the whole screen is stale. */
+static bool background_update(void)
+{
+    if (background_valid && background_generation == sim.obstacle_generation)
+        return false;
+    for (int y = 0; y < fb_height; y++)
+        blit_plot_run(&background, 0, y, fb_width, native_colour(background_rows[y]));
+    draw_obstacles(&background);
+    background_generation = sim.obstacle_generation;
+    background_valid = true;
+#ifdef HAVE_OPENGL
+    hw_background_stale = true;
+#endif
+    return true;
+}
+
+/* Clear a surface to the background layer. */
+static void clear_background(const surface_t *s)
+{
+    blit_sprite(s, 0, 0, background.pixels, fb_width, fb_height, background.stride);
+}
+
+/* Restore the background layer underneath a single grid cell. */
+static void clear_background_cell(int cx, int cy)
+{
+    int px = cx * cell_size;
+    int py = cy * cell_size;
+    blit_sprite(&screen, px, py, surface_pixel(&background, px, py), cell_size, cell_size, background.stride);
+}
+
+/* Draw the entire frame: background, particles, snake, food, item,
+ * HUD and overlays. */
+static void draw_frame(const surface_t *s)
+{
+    PROFILE_BEGIN(PROF_CLEAR);
+    clear_background(s);
+    PROFILE_END(PROF_CLEAR);
+    /* Draw particles first so objects draw on top. Obstacles live in
+     * the background layer but are meant to cover particles. */
+    PROFILE_BEGIN(PROF_DRAW_PARTICLES);
+    for (int i = 0; i < particles.count; i++)
+    {
+        int cx, cy, px, py;
+        if (particle_cell(i, &cx, &cy) && !cell_hidden(cx, cy))
+        {
+            particle_pos(i, &px, &py);
+            blit_plot(s, px, py, native_colour(particles.colour[i]));
+        }
+    }
+    PROFILE_END(PROF_DRAW_PARTICLES);
+    PROFILE_BEGIN(PROF_DRAW_SNAKE);
+    draw_snake(s);
+    PROFILE_END(PROF_DRAW_SNAKE);
+    PROFILE_BEGIN(PROF_DRAW_FOOD);
+    draw_food(s);
+    PROFILE_END(PROF_DRAW_FOOD);
+    PROFILE_BEGIN(PROF_DRAW_ITEM);
+    draw_item(s);
+    PROFILE_END(PROF_DRAW_ITEM);
+    PROFILE_BEGIN(PROF_DRAW_HUD);
+    draw_scoreboard(s);
+    PROFILE_END(PROF_DRAW_HUD);
+    PROFILE_BEGIN(PROF_DRAW_OVERLAY);
+    draw_overlay(s);
+    PROFILE_END(PROF_DRAW_OVERLAY);
+}
+
+/* Title, pause and game over screens on top of the board. */
+static void draw_overlay(const surface_t *s)
+{
+    if (state == STATE_GAMEOVER)
+    {
+        draw_gameover_overlay(s);
+    }
+    else if (state == STATE_PAUSE)
+    {
+        /* Darken background and draw "PAUSED" */
+        dim_screen(s);
+        const char *msg = "PAUSED";
+        int len = (int)strlen(msg);
+        int px = (fb_width - len * 8) / 2;
+        int py = fb_height / 2 - 4;
+        draw_text(s, px, py, msg, HUD_TEXT_COLOUR);
+    }
+    else if (state == STATE_TITLE)
+    {
+        /* Title screen: show game name and instructions. */
+        const char *title = "SNAKE";
+        int len = (int)strlen(title);
+        int px = (fb_width - len * 8) / 2;
+        int py = fb_height / 2 - 32;
+        draw_text(s, px, py, title, HUD_TEXT_COLOUR);
+        const char *sub = "PRESS START";
+        len = (int)strlen(sub);
+        px = (fb_width - len * 8) / 2;
+        py += 24;
+        draw_text(s, px, py, sub, HUD_TEXT_COLOUR);
+        const char *inst = "ARROWS TO MOVE";
+        len = (int)strlen(inst);
+        px = (fb_width - len * 8) / 2;
+        py += 16;
+        draw_text(s, px, py, inst, HUD_TEXT_COLOUR);
+    }
+}
+
+/* ------------------------------------------------------------------
+ * Incremental renderer
+ *
+ * During play most of the picture is unchanged from one frame to the
+ * next: the snake only moves every few frames and the board is static.
+ * Instead of repainting everything, we remember which cells the moving
+ * objects covered when the last frame was drawn, mark those and the
+ * currently covered cells dirty, and repaint only the dirty cells. All
+ * sprites except particles and the HUD are confined to their cell, so
+ * redrawing the objects of a dirty cell in draw_frame() order yields
+ * exactly the same pixels as a full repaint. Any other state (title,
+ * pause, game over) and any discontinuity such as a reset or loading a
+ * state falls back to a full repaint.
+ */
+
+/* Rows of cells overlapped by the scoreboard. */
+#define HUD_CELL_ROWS ((HUD_BOTTOM + cell_size - 1) / cell_size)
+
+/* Everything that influences how the snake looks. When this differs
+ * from the previous frame the whole snake is repainted. */
+typedef struct
+{
+    int head_x, head_y;
+    int length;
+    snek_dir_t dir;
+    colour_t head, body;
+    bool phasing;
+} snake_look_t;
+
+static bool render_incremental = true;
+static bool render_full_pending = true;
+/* Set when the snake was replaced wholesale, so that its look alone
+ * does not tell whether the body moved. */
+static bool render_snake_replaced = false;
+static game_state_t prev_state = STATE_TITLE;
+
+static uint8_t *dirty_map = NULL;
+static uint16_t *dirty_list = NULL;
+static int dirty_count = 0;
+
+/* Footprint of the previously drawn frame. */
+static snake_look_t prev_snake_look;
+static uint16_t *prev_snake_cells = NULL;
+static hud_look_t prev_hud_look;
+static int prev_food_x, prev_food_y;
+static snek_item_t prev_item_type;
+static int prev_item_x, prev_item_y;
+static uint16_t *prev_particle_cells = NULL;
+static int prev_particle_count = 0;
+
+static void mark_dirty(int cx, int cy)
+{
+    if (cx < 0 || cx >= grid_w || cy < 0 || cy >= grid_h)
+        return;
+    int idx = cy * grid_w + cx;
+    if (!dirty_map[idx])
+    {
+        dirty_map[idx] = 1;
+        dirty_list[dirty_count++] = (uint16_t)idx;
+    }
+}
+
+static bool is_dirty(int cx, int cy)
+{
+    if (cx < 0 || cx >= grid_w || cy < 0 || cy >= grid_h)
+        return false;
+    return dirty_map[cy * grid_w + cx] != 0;
+}
+
+static void current_snake_look(snake_look_t *look)
+{
+    look->head_x = snek_sim_seg_x(&sim, 0);
+    look->head_y = snek_sim_seg_y(&sim, 0);
+    look->length = sim.length;
+    look->dir = sim.dir;
+    snake_colours(&look->head, &look->body);
+    look->phasing = (sim.phase_timer > 0);
+}
+
+static bool snake_look_equal(const snake_look_t *a, const snake_look_t *b)
+{
+    return a->head_x == b->head_x && a->head_y == b->head_y &&
+           a->length == b->length && a->dir == b->dir &&
+           a->head == b->head && a->body == b->body && a->phasing == b->phasing;
+}
+
+/* Remember what was drawn this frame so the next incremental frame
+ * knows which cells to clean up. The snake is only copied when it
+ * changed (or after a full repaint, where the body may have been
+ * replaced wholesale). */
+static void record_footprint(bool full)
+{
+    snake_look_t look;
+    current_snake_look(&look);
+    if (full || render_snake_replaced || !snake_look_equal(&look, &prev_snake_look))
+    {
+        prev_snake_look = look;
+        for (int i = 0; i < sim.length; i++)
+            prev_snake_cells[i] = (uint16_t)snek_sim_seg_cell(&sim, i);
+    }
+    current_hud_look(&prev_hud_look);
+    prev_food_x = sim.food_x;
+    prev_food_y = sim.food_y;
+    prev_item_type = sim.item_type;
+    prev_item_x = sim.item_x;
+    prev_item_y = sim.item_y;
+    prev_particle_count = 0;
+    for (int i = 0; i < particles.count; i++)
+    {
+        int cx, cy;
+        if (particle_cell(i, &cx, &cy))
+            prev_particle_cells[prev_particle_count++] = (uint16_t)(cy * grid_w + cx);
+    }
+}
+
+/* Determine which cells changed since the previous frame. */
+static void collect_dirty_cells(void)
+{
+    snake_look_t snake_look;
+    current_snake_look(&snake_look);
+    if (render_snake_replaced || !snake_look_equal(&snake_look, &prev_snake_look))
+    {
+        for (int i = 0; i < prev_snake_look.length; i++)
+            mark_dirty(prev_snake_cells[i] % grid_w, prev_snake_cells[i] / grid_w);
+        for (int i = 0; i < sim.length; i++)
+            mark_dirty(snek_sim_seg_x(&sim, i), snek_sim_seg_y(&sim, i));
+    }
+    if (sim.food_x != prev_food_x || sim.food_y != prev_food_y)
+    {
+        mark_dirty(prev_food_x, prev_food_y);
+        mark_dirty(sim.food_x, sim.food_y);
+    }
+    if (sim.item_type != prev_item_type || sim.item_x != prev_item_x || sim.item_y != prev_item_y)
+    {
+        if (prev_item_type != SNEK_ITEM_NONE)
+            mark_dirty(prev_item_x, prev_item_y);
+        if (sim.item_type != SNEK_ITEM_NONE)
+            mark_dirty(sim.item_x, sim.item_y);
+    }
+    for (int i = 0; i < prev_particle_count; i++)
+        mark_dirty(prev_particle_cells[i] % grid_w, prev_particle_cells[i] / grid_w);
+    for (int i = 0; i < particles.count; i++)
+    {
+        int cx, cy;
+        if (particle_cell(i, &cx, &cy))
+            mark_dirty(cx, cy);
+    }
+    hud_look_t hud_look;
+    current_hud_look(&hud_look);
+    if (!hud_look_equal(&hud_look, &prev_hud_look))
+    {
+        for (int cy = 0; cy < HUD_CELL_ROWS; cy++)
+            for (int cx = 0; cx < grid_w; cx++)
+                mark_dirty(cx, cy);
+    }
+}
+
+/* Repaint only the dirty cells, drawing their contents in the same
+ * order as draw_frame(). */
+static void dirty_clear(void)
+{
+    for (int i = 0; i < dirty_count; i++)
+        dirty_map[dirty_list[i]] = 0;
+    dirty_count = 0;
+}
+
+/* Repaint only the dirty cells collected by render_needed(). */
+static void draw_frame_incremental(void)
+{
+    bool hud_touched = false;
+    PROFILE_BEGIN(PROF_CLEAR);
+    for (int i = 0; i < dirty_count; i++)
+    {
+        int cx = dirty_list[i] % grid_w;
+        int cy = dirty_list[i] / grid_w;
+        clear_background_cell(cx, cy);
+        if (cy < HUD_CELL_ROWS)
+            hud_touched = true;
+    }
+    PROFILE_END(PROF_CLEAR);
+    PROFILE_BEGIN(PROF_DRAW_PARTICLES);
+    for (int i = 0; i < particles.count; i++)
+    {
+        int cx, cy, px, py;
+        if (particle_cell(i, &cx, &cy) && is_dirty(cx, cy) && !cell_hidden(cx, cy))
+        {
+            particle_pos(i, &px, &py);
+            blit_plot(&screen, px, py, native_colour(particles.colour[i]));
+        }
+    }
+    PROFILE_END(PROF_DRAW_PARTICLES);
+    PROFILE_BEGIN(PROF_DRAW_SNAKE);
+    colour_t head, body;
+    snake_colours(&head, &body);
+    bool phasing = (sim.phase_timer > 0);
+    for (int i = 0; i < sim.length; i++)
+    {
+        if (is_dirty(snek_sim_seg_x(&sim, i), snek_sim_seg_y(&sim, i)))
+            draw_snake_segment(&screen, i, head, body, phasing);
+    }
+    PROFILE_END(PROF_DRAW_SNAKE);
+    PROFILE_BEGIN(PROF_DRAW_FOOD);
+    if (is_dirty(sim.food_x, sim.food_y))
+        draw_food(&screen);
+    PROFILE_END(PROF_DRAW_FOOD);
+    PROFILE_BEGIN(PROF_DRAW_ITEM);
+    if (sim.item_type != SNEK_ITEM_NONE && is_dirty(sim.item_x, sim.item_y))
+        draw_item(&screen);
+    PROFILE_END(PROF_DRAW_ITEM);
+    PROFILE_BEGIN(PROF_DRAW_HUD);
+    if (hud_touched)
+        draw_scoreboard(&screen);
+    PROFILE_END(PROF_DRAW_HUD);
+    dirty_clear();
+}
+
+/* Work out whether this frame would look any different from the last
+ * one drawn. The footprint comparison covers everything the game can
+ * change; title, pause and game over overlays are static, so a change
+ * of state is the only other trigger. This is how unchanged frames are
+ * found without comparing pixels. Leaves the dirty cells collected for
+ * render_frame(). */
+static bool render_needed(void)
+{
+    if (background_update())
+        render_full_pending = true;
+    if (render_full_pending || state != prev_state)
+        return true;
+    collect_dirty_cells();
+    return dirty_count > 0;
+}
+
+#ifdef HAVE_OPENGL
+/* ------------------------------------------------------------------
+ * Hardware renderer
+ *
+ * With snek_renderer set to hardware the frame is drawn by the GPU
+ * through gl_render.h: the background layer (gradient and obstacles)
+ * is a texture, uploaded again only when it is rebuilt, and everything
+ * else is one batch of quads from a single atlas. The sprites go into
+ * the atlas as baked. The body's shading classes become texels that
+ * add a constant to a scaled segment colour, the same
+ * affine mix draw_snake_body() applies, so the segment colour is all a
+ * body quad carries. The frontend does not keep its framebuffer, so
+ * every frame that is not a dupe is drawn in full.
+ */
+
+/* Texel for body shading class cls: out = add + m × segment colour. */
+static void hw_body_texel(uint8_t *texel, int cls, bool phasing)
+{
+    float m = 1.0f;
+    float add[3] = {0.0f, 0.0f, 0.0f};
+    colour_t toward[3];
+    float mix[3];
+    int mixes = 0;
+    if (cls == BODY_CLASS_NONE)
+    {
+        texel[0] = texel[1] = texel[2] = texel[3] = 0;
+        return;
+    }
+    if (cls == BODY_CLASS_STRIPE || cls == BODY_CLASS_STRIPE_DOT)
+    {
+        toward[mixes] = BODY_STRIPE_COLOUR;
+        mix[mixes++] = BODY_STRIPE_MIX;
+    }
+    if (cls == BODY_CLASS_DOT || cls == BODY_CLASS_STRIPE_DOT)
+    {
+        toward[mixes] = BODY_DOT_COLOUR;
+        mix[mixes++] = BODY_DOT_MIX;
+    }
+    if (phasing)
+    {
+        toward[mixes] = PHASE_COLOUR;
+        mix[mixes++] = BODY_PHASE_MIX;
+    }
+    for (int i = 0; i < mixes; i++)
+    {
+        m *= 1.0f - mix[i];
+        for (int c = 0; c < 3; c++)
+            add[c] = add[c] * (1.0f - mix[i]) + (float)((toward[i] >> (16 - 8 * c)) & 0xFF) * mix[i];
+    }
+    for (int c = 0; c < 3; c++)
+        texel[c] = (uint8_t)lroundf(add[c]);
+    texel[3] = (uint8_t)lroundf(m * 255.0f);
+}
+
+/* Build the atlas (see HW_ATLAS_HEIGHT) and hand it to the GPU. */
+static void hw_upload_atlas(void)
+{
+    uint8_t *atlas = (uint8_t *)calloc((size_t)cell_size * HW_ATLAS_HEIGHT, 4);
+    if (!atlas)
+        return;
+    for (int id = 0; id < SPRITE_COUNT; id++)
+        sprite_bake(id);
+    for (int i = 0; i < SPRITE_COUNT * SPRITE_PIXELS; i++)
+    {
+        colour_t c = sprite_atlas[i];
+        if (c == SPRITE_KEY)
+            continue;
+        atlas[i * 4 + 0] = (uint8_t)(c >> 16);
+        atlas[i * 4 + 1] = (uint8_t)(c >> 8);
+        atlas[i * 4 + 2] = (uint8_t)c;
+        atlas[i * 4 + 3] = 255;
+    }
+    for (int phasing = 0; phasing < 2; phasing++)
+    {
+        uint8_t *cell = atlas + (size_t)(HW_ATLAS_BODY_Y + phasing * cell_size) * cell_size * 4;
+        for (int i = 0; i < SPRITE_PIXELS; i++)
+            hw_body_texel(cell + i * 4, body_classes[i], phasing != 0);
+    }
+    for (size_t g = 0; g < GLYPH_COUNT; g++)
+    {
+        for (int y = 0; y < 8; y++)
+        {
+            uint8_t *row = atlas + (size_t)(HW_ATLAS_GLYPH_Y + (int)g * 8 + y) * cell_size * 4;
+            for (int x = 0; x < 8; x++)
+            {
+                if (glyph_masks[g][y] & (1u << x))
+                    row[x * 4 + 0] = row[x * 4 + 1] = row[x * 4 + 2] = row[x * 4 + 3] = 255;
             }
         }
-        x += 8;
     }
+    uint8_t *texels = atlas + (size_t)HW_ATLAS_TEXEL_Y * cell_size * 4;
+    texels[0] = texels[1] = texels[2] = texels[3] = 255;
+    /* Dimming keeps 2/5 of what is beneath, as blit_scale() does. */
+    texels[7] = 255 - 255 * 2 / 5;
+    gl_render_set_atlas(atlas, cell_size, HW_ATLAS_HEIGHT);
+    free(atlas);
+}
+
+static void hw_cell_sprite(int id, int cx, int cy)
+{
+    gl_render_sprite(cx * cell_size, cy * cell_size, cell_size, cell_size, 0, id * cell_size, 0xFFFFFFu);
+}
+
+/* Draw the frame on the GPU in draw_frame() order. */
+static void draw_frame_gl(void)
+{
+    if (!hw_ready)
+        return;
+    if (hw_atlas_stale)
+    {
+        hw_upload_atlas();
+        hw_atlas_stale = false;
+    }
+    if (hw_background_stale)
+    {
+        gl_render_set_background((const uint32_t *)background.pixels, fb_width, fb_height, background.stride);
+        hw_background_stale = false;
+    }
+    gl_render_begin();
+    for (int i = 0; i < particles.count; i++)
+    {
+        int cx, cy, px, py;
+        if (particle_cell(i, &cx, &cy) && !cell_hidden(cx, cy))
+        {
+            particle_pos(i, &px, &py);
+            gl_render_fill(px, py, 1, 1, 0, HW_ATLAS_TEXEL_Y, particles.colour[i]);
+        }
+    }
+    colour_t head, body;
+    snake_colours(&head, &body);
+    bool phasing = (sim.phase_timer > 0);
+    for (int i = 0; i < sim.length; i++)
+    {
+        int x = snek_sim_seg_x(&sim, i);
+        int y = snek_sim_seg_y(&sim, i);
+        if (cell_hidden(x, y))
+            continue;
+        if (i == 0)
+        {
+            int id = head_sprite_id(sim.dir, head, phasing);
+            if (id >= 0)
+                hw_cell_sprite(id, x, y);
+        }
+        else
+        {
+            float t = (sim.length > 1) ? (float)i / (float)(sim.length - 1) : 0.f;
+            gl_render_shaded(x * cell_size, y * cell_size, cell_size, cell_size, 0,
+                             HW_ATLAS_BODY_Y + (phasing ? cell_size : 0), body_colour(body, t));
+        }
+    }
+    if (!cell_hidden(sim.food_x, sim.food_y))
+        hw_cell_sprite(SPRITE_FOOD, sim.food_x, sim.food_y);
+    if (!cell_hidden(sim.item_x, sim.item_y))
+    {
+        if (sim.item_type == SNEK_ITEM_PHASE)
+            hw_cell_sprite(SPRITE_ITEM_PHASE, sim.item_x, sim.item_y);
+        else if (sim.item_type == SNEK_ITEM_SPEED)
+            hw_cell_sprite(SPRITE_ITEM_SPEED, sim.item_x, sim.item_y);
+    }
+    hud_update();
+    for (int y = 0; y < HUD_HEIGHT; y++)
+    {
+        for (int r = hud_row_start[y]; r < hud_row_start[y + 1]; r++)
+            gl_render_fill(hud_runs[r].start, HUD_TOP + y, hud_runs[r].len, 1, 0, HW_ATLAS_TEXEL_Y,
+                           hud_runs[r].colour);
+    }
+    draw_overlay(NULL);
+    gl_render_end(hw_render.get_current_framebuffer(), fb_width, fb_height);
+}
+
+static void RETRO_CALLCONV hw_context_reset(void)
+{
+    hw_ready = gl_render_init(hw_render.get_proc_address);
+    hw_atlas_stale = true;
+    hw_background_stale = true;
+}
+
+static void RETRO_CALLCONV hw_context_destroy(void)
+{
+    gl_render_deinit();
+    hw_ready = false;
+}
+
+/* Ask the frontend for an OpenGL (ES) 2.0 context. */
+static bool hw_render_setup(void)
+{
+    memset(&hw_render, 0, sizeof(hw_render));
+#ifdef HAVE_OPENGLES
+    hw_render.context_type = RETRO_HW_CONTEXT_OPENGLES2;
+#else
+    hw_render.context_type = RETRO_HW_CONTEXT_OPENGL;
+#endif
+    hw_render.version_major = 2;
+    hw_render.version_minor = 0;
+    hw_render.context_reset = hw_context_reset;
+    hw_render.context_destroy = hw_context_destroy;
+    hw_render.bottom_left_origin = true;
+    hw_render.depth = false;
+    hw_render.stencil = false;
+    return env_cb(RETRO_ENVIRONMENT_SET_HW_RENDER, &hw_render);
+}
+#endif
+
+/* ------------------------------------------------------------------
+ * Banded rendering
+ *
+ * With snek_render_threads above 1, full repaints are split into
+ * horizontal bands of whole cell rows, one per thread of a persistent
+ * pool. Each band is the screen with its clip rectangle narrowed to
+ * the band, and every primitive clips, so each thread runs the whole
+ * of draw_frame() and writes only its own rows. Every pixel still sees
+ * the layers in draw_frame() order, so the picture is the same as a
+ * single-threaded repaint. The workers only read the game; anything
+ * draw_frame() would cache is brought up to date before they start.
+ * Incremental frames touch a few cells and stay on the caller.
+ */
+static int render_threads = 1;
+static band_pool_t *render_pool = NULL;
+static surface_t *render_bands = NULL;
+static int render_band_count = 0;
+
+static void render_pool_deinit(void)
+{
+    band_pool_destroy(render_pool);
+    render_pool = NULL;
+    free(render_bands);
+    render_bands = NULL;
+}
+
+/* Start or stop the pool for render_threads (0 for one per CPU). */
+static void render_pool_setup(void)
+{
+    render_pool_deinit();
+    if (render_threads == 1)
+        return;
+    render_pool = band_pool_create(render_threads);
+    if (!render_pool)
+        return;
+    render_bands = (surface_t *)malloc((size_t)band_pool_threads(render_pool) * sizeof(surface_t));
+    if (!render_bands || band_pool_threads(render_pool) == 1)
+        render_pool_deinit();
+}
+
+static void draw_band(void *data, int band)
+{
+    (void)data;
+    if (band < render_band_count)
+        draw_frame(&render_bands[band]);
+}
+
+static void draw_frame_banded(void)
+{
+    int bands = band_pool_threads(render_pool);
+    if (bands > grid_h)
+        bands = grid_h;
+    for (int b = 0; b < bands; b++)
+    {
+        int y0 = grid_h * b / bands * cell_size;
+        int y1 = b + 1 < bands ? grid_h * (b + 1) / bands * cell_size : fb_height;
+        render_bands[b] = screen;
+        surface_set_clip(&render_bands[b], 0, y0, fb_width, y1 - y0);
+    }
+    render_band_count = bands;
+    hud_update();
+    PROFILE_BEGIN(PROF_DRAW_BANDS);
+#ifdef SNEK_PROFILE
+    profile_paused = true;
+#endif
+    band_pool_run(render_pool, draw_band, NULL);
+#ifdef SNEK_PROFILE
+    profile_paused = false;
+#endif
+    PROFILE_END(PROF_DRAW_BANDS);
+}
+
+/* Render the current frame after render_needed(), incrementally where
+ * possible. The overlays darken the whole picture, so anything but
+ * play is always a full repaint. */
+static void render_frame(void)
+{
+    sprites_prepare();
+    bool full = !render_incremental || render_full_pending || state != prev_state ||
+                state != STATE_PLAY;
+#ifdef HAVE_OPENGL
+    if (hw_enabled)
+        full = true;
+#endif
+    if (full)
+    {
+        dirty_clear();
+#ifdef HAVE_OPENGL
+        if (hw_enabled)
+            draw_frame_gl();
+        else
+#endif
+        if (render_pool)
+            draw_frame_banded();
+        else
+            draw_frame(&screen);
+    }
+    else
+    {
+        draw_frame_incremental();
+    }
+    render_full_pending = false;
+    prev_state = state;
+    record_footprint(full);
+    render_snake_replaced = false;
+}
+
+/* Request a full repaint on the next frame, e.g. after the board was
+ * replaced by a reset or a loaded state. */
+static void render_invalidate(void)
+{
+    render_full_pending = true;
+}
+
+/* Note that the board was put back to an earlier position, e.g. by
+ * loading a state. Unlike a reset the obstacles usually stay, so the
+ * footprint comparison still finds the changed cells, as long as the
+ * whole snake is taken as moved. */
+static void render_reload(void)
+{
+    render_snake_replaced = true;
+}
+
+/* Pick the buffer the next frame is drawn into. When the frontend
+ * lends us its own framebuffer (GET_CURRENT_SOFTWARE_FRAMEBUFFER) we
+ * draw straight into it at its pitch, which saves it a copy of every
+ * frame. Its contents are not kept between frames, so drawing there is
+ * always a full repaint, as is the first frame back in video_buffer. */
+static bool frontend_fb_enabled = true;
+static bool screen_external = false;
+
+/* Whether video_cb accepts NULL for "same picture as last frame". */
+static bool can_dupe = false;
+
+static void select_render_target(void)
+{
+    struct retro_framebuffer fb;
+    memset(&fb, 0, sizeof(fb));
+    fb.width = (unsigned)fb_width;
+    fb.height = (unsigned)fb_height;
+    /* Read access for the pause and game over dimming. */
+    fb.access_flags = RETRO_MEMORY_ACCESS_WRITE | RETRO_MEMORY_ACCESS_READ;
+    size_t bpp = (size_t)surface_format_bytes(pixel_format);
+    unsigned retro_format = pixel_format == SURFACE_RGB565 ? RETRO_PIXEL_FORMAT_RGB565
+                                                           : RETRO_PIXEL_FORMAT_XRGB8888;
+    bool external = frontend_fb_enabled &&
+                    env_cb(RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER, &fb) && fb.data &&
+                    fb.format == retro_format && fb.width == (unsigned)fb_width &&
+                    fb.height == (unsigned)fb_height && fb.pitch >= (size_t)fb_width * bpp &&
+                    fb.pitch % bpp == 0;
+    if (external)
+    {
+        surface_init(&screen, fb.data, pixel_format, fb_width, fb_height, (int)(fb.pitch / bpp));
+        video_pitch = fb.pitch;
+        render_invalidate();
+    }
+    else
+    {
+        if (screen_external)
+            render_invalidate();
+        surface_init(&screen, video_buffer, pixel_format, fb_width, fb_height, fb_width);
+        video_pitch = fb_width * bpp;
+    }
+    screen_external = external;
+}
+
+/* (Re)allocate the framebuffer and background layer for a pixel
+ * format at the current framebuffer size. Everything that caches
+ * native colours is rebuilt. Returns false if memory runs out. */
+static bool video_setup(surface_format_t format)
+{
+    size_t bytes = (size_t)fb_width * fb_height * (size_t)surface_format_bytes(format);
+    free(video_buffer);
+    free(background_buffer);
+    pixel_format = format;
+    video_buffer = calloc(bytes, 1);
+    background_buffer = malloc(bytes);
+    video_pitch = fb_width * (size_t)surface_format_bytes(format);
+    surface_init(&screen, video_buffer, format, fb_width, fb_height, fb_width);
+    surface_init(&background, background_buffer, format, fb_width, fb_height, fb_width);
+    screen_external = false;
+    background_valid = false;
+    hud_cached = false;
+    render_invalidate();
+    return video_buffer && background_buffer;
+}
+
+static void geometry_deinit(void);
+
+/* Switch to a board of w×h cells of cell pixels each. Everything sized
+ * by the grid or the framebuffer is reallocated and the sprites are
+ * baked again. The board contents are lost, so the caller must follow
+ * up with game_reset(). Returns false if memory runs out, leaving no
+ * board at all: the caller falls back to a smaller one. */
+static bool geometry_apply(int w, int h, int cell)
+{
+    grid_w = w;
+    grid_h = h;
+    grid_cells = w * h;
+    cell_size = cell;
+    fb_width = w * cell;
+    fb_height = h * cell;
+
+    /* The random stream and the high score outlive the board. */
+    uint64_t rng = sim.rng_state;
+    int highscore = sim.highscore;
+    snek_sim_free(&sim);
+    bool ok = snek_sim_init(&sim, w, h, 0);
+    sim.rng_state = rng;
+    sim.highscore = highscore;
+    /* The game does not need the bot; without it the autopilot just
+     * stays off (see game_frame()). */
+    snek_bot_free(&bot);
+    if (ok)
+        snek_bot_init(&bot, &sim);
+
+    free(dirty_map);
+    free(dirty_list);
+    free(prev_snake_cells);
+    free(state_body);
+    dirty_map = (uint8_t *)calloc((size_t)grid_cells, 1);
+    dirty_list = (uint16_t *)malloc((size_t)grid_cells * sizeof(uint16_t));
+    prev_snake_cells = (uint16_t *)malloc((size_t)grid_cells * sizeof(uint16_t));
+    state_body = (uint16_t *)malloc((size_t)grid_cells * sizeof(uint16_t));
+    dirty_count = 0;
+    prev_snake_look.length = 0;
+    prev_particle_count = 0;
+    ok = ok && dirty_map && dirty_list && prev_snake_cells && state_body;
+
+    ok = ok && sprites_init() && background_init() && hud_resize() && video_setup(pixel_format);
+    if (!ok)
+    {
+        geometry_deinit();
+        sim.rng_state = rng;
+        sim.highscore = highscore;
+    }
+    return ok;
+}
+
+/* Free everything sized by the board and the framebuffer. */
+static void geometry_deinit(void)
+{
+    snek_sim_free(&sim);
+    snek_bot_free(&bot);
+    free(dirty_map);
+    free(dirty_list);
+    free(prev_snake_cells);
+    free(state_body);
+    free(background_rows);
+    free(hud_canvas);
+    free(video_buffer);
+    free(background_buffer);
+    dirty_list = prev_snake_cells = state_body = NULL;
+    dirty_map = NULL;
+    background_rows = NULL;
+    hud_canvas = NULL;
+    video_buffer = background_buffer = NULL;
+    grid_w = grid_h = grid_cells = 0;
+    cell_size = fb_width = fb_height = 0;
+    sprites_deinit();
+}
+
+static void particle_pool_deinit(void);
+
+/* Resize the particle pool. Live particles are dropped. Returns false
+ * if memory runs out, leaving an empty pool of no capacity. */
+static bool particle_pool_setup(int capacity)
+{
+    free(particles.x);
+    free(particles.y);
+    free(particles.vx);
+    free(particles.vy);
+    free(particles.lifetime);
+    free(particles.colour);
+    free(prev_particle_cells);
+    particles.x = (int32_t *)malloc((size_t)capacity * sizeof(int32_t));
+    particles.y = (int32_t *)malloc((size_t)capacity * sizeof(int32_t));
+    particles.vx = (int32_t *)malloc((size_t)capacity * sizeof(int32_t));
+    particles.vy = (int32_t *)malloc((size_t)capacity * sizeof(int32_t));
+    particles.lifetime = (int32_t *)malloc((size_t)capacity * sizeof(int32_t));
+    particles.colour = (colour_t *)malloc((size_t)capacity * sizeof(colour_t));
+    prev_particle_cells = (uint16_t *)malloc((size_t)capacity * sizeof(uint16_t));
+    particles.count = 0;
+    particles.capacity = capacity;
+    prev_particle_count = 0;
+    render_invalidate();
+    if (!particles.x || !particles.y || !particles.vx || !particles.vy || !particles.lifetime ||
+        !particles.colour || !prev_particle_cells)
+    {
+        particle_pool_deinit();
+        return false;
+    }
+    return true;
+}
+
+static void particle_pool_deinit(void)
+{
+    free(particles.x);
+    free(particles.y);
+    free(particles.vx);
+    free(particles.vy);
+    free(particles.lifetime);
+    free(particles.colour);
+    free(prev_particle_cells);
+    memset(&particles, 0, sizeof(particles));
+    prev_particle_cells = NULL;
+}
+
+/* Board size and cell size from the core options. The cell size is
+ * raised if needed to give the HUD its minimum framebuffer, and
+ * lowered if needed to stay within MAX_FB_PIXELS. */
+static void geometry_from_options(int *w, int *h, int *cell)
+{
+    *w = DEFAULT_GRID_W;
+    *h = DEFAULT_GRID_H;
+    *cell = DEFAULT_CELL_SIZE;
+    struct retro_variable var = {"snek_grid_size", NULL};
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        int vw, vh;
+        if (sscanf(var.value, "%dx%d", &vw, &vh) == 2 && vw >= 4 && vh >= 4 && vw * vh <= MAX_GRID_CELLS)
+        {
+            *w = vw;
+            *h = vh;
+        }
+    }
+    var.key = "snek_cell_size";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        int size = atoi(var.value);
+        if (size >= MIN_CELL_SIZE && size <= MAX_CELL_SIZE)
+            *cell = size;
+    }
+    while (*cell < MAX_CELL_SIZE && (*w * *cell < MIN_FB_WIDTH || *h * *cell < MIN_FB_HEIGHT))
+        (*cell)++;
+    while (*cell > MIN_CELL_SIZE && *w * *cell * *h * *cell > MAX_FB_PIXELS)
+        (*cell)--;
 }
 
-/* Draw the scoreboard at the top of the screen. The current score
- * appears on the left and the high score on the right. Each number
- * is rendered using the seven‑segment display. */
-static void draw_scoreboard(void)
+/* ------------------------------------------------------------------
+ * Libretro core API implementation
+ */
+
+void retro_set_environment(retro_environment_t cb)
 {
-    char label_score[] = "SCORE";
-    char label_hi[] = "HI";
-    int base_y = 16;
-    int label_x = 8;
-    draw_text(label_x, base_y, label_score, HUD_TEXT_COLOUR);
-    /* Draw current score digits. We show up to 5 digits. */
-    int sc = score;
-    for (int i = 0; i < 5; i++)
+    env_cb = cb;
+    /* Provide descriptive names for controls. */
+    struct retro_input_descriptor desc[] = {
+        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP, "Up"},
+        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN, "Down"},
+        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT, "Left"},
+        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT, "Right"},
+        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START, "Start"},
+        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_SELECT, "Reset Highscore"},
+        {0, 0, 0, 0, NULL}};
+    env_cb(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
+
+    bool contentless = true;
+    env_cb(RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME, &contentless);
+
+    /* Core options. The first value listed is the default. */
+    static const struct retro_variable vars[] = {
+        {"snek_render_mode", "Render mode; incremental|full"},
+        {"snek_render_threads", "Render threads for full repaints; 1|2|3|4|6|8|auto"},
+        {"snek_frontend_framebuffer", "Draw into frontend framebuffer; enabled|disabled"},
+#ifdef HAVE_OPENGL
+        {"snek_renderer", "Renderer (restart); software|hardware"},
+#endif
+        {"snek_pixel_format", "Pixel format (restart); xrgb8888|rgb565"},
+        {"snek_grid_size", "Board size (resets game); 40x30|20x15|32x24|48x36|64x48|80x60|128x96|160x120|240x180"},
+        {"snek_cell_size", "Cell size in pixels (resets game; smaller on boards past 3840x2160 pixels); 16|8|12|24|32"},
+        {"snek_particles", "Particle limit; 128|256|512|1024|2048|4096|8192"},
+        {"snek_sound", "Sound effects; enabled|disabled"},
+        {"snek_autopilot", "Autopilot (attract mode; about 1 microsecond a move, up to 15 on 240x180 boards); disabled|enabled"},
+        {"snek_refresh_rate", "Display refresh rate in Hz; 60|50|75|90|100|120|144|165|240"},
+        {"snek_movie", "Input movie; off|record|play|loop"},
+        {"snek_movie_seek", "Movie playback starts at; beginning|end"},
+#ifdef SNEK_PROFILE
+        {"snek_profiler", "Profiler overlay; disabled|enabled"},
+#endif
+        {NULL, NULL}};
+    env_cb(RETRO_ENVIRONMENT_SET_VARIABLES, (void *)vars);
+}
+
+/* The buttons of this frame with the autopilot at the controls: the
+ * directions are its own, and Start is pressed for the player once
+ * the title or game over screen has been up for AUTOPILOT_WAIT ticks.
+ * Start still pauses, and Select still works on the title screen. */
+static unsigned autopilot_buttons(unsigned buttons)
+{
+    buttons &= ~(unsigned)(1 << RETRO_DEVICE_ID_JOYPAD_UP | 1 << RETRO_DEVICE_ID_JOYPAD_DOWN |
+                           1 << RETRO_DEVICE_ID_JOYPAD_LEFT | 1 << RETRO_DEVICE_ID_JOYPAD_RIGHT);
+    if (state != STATE_TITLE && state != STATE_GAMEOVER)
+        autopilot_wait = AUTOPILOT_WAIT;
+    else if (--autopilot_wait == 0)
     {
-        int digit = sc % 10;
-        sc /= 10;
-        int dx = 8 + (4 - i) * 24;
-        draw_digit(dx, 32, digit, HUD_TEXT_COLOUR);
+        buttons |= 1 << RETRO_DEVICE_ID_JOYPAD_START;
+        autopilot_wait = AUTOPILOT_WAIT;
     }
-    /* Draw high score on the right. */
-    draw_text(FB_WIDTH - 8 - 2 * 8 - 5 * 24 - 4, base_y, label_hi, HUD_TEXT_COLOUR);
-    int hs = highscore;
-    for (int i = 0; i < 5; i++)
+    return buttons;
+}
+
+/* One frame of game logic for the given buttons. Without effects the
+ * particles are left alone; the game itself never depends on them. */
+static void game_frame(unsigned buttons, bool effects)
+{
+    PROFILE_BEGIN(PROF_INPUT);
+    if (autopilot)
+        buttons = autopilot_buttons(buttons);
+    handle_input(buttons);
+    PROFILE_END(PROF_INPUT);
+    if (state != STATE_PLAY)
+        return;
+    /* The autopilot picks the way of a move on the tick it is made,
+     * when it sees the board the move starts from. */
+    int action = SNEK_ACTION_NONE;
+    if (autopilot && bot.dist && sim.move_counter <= 1)
     {
-        int digit = hs % 10;
-        hs /= 10;
-        int dx = FB_WIDTH - 8 - (i + 1) * 24;
-        draw_digit(dx, 32, digit, HUD_TEXT_COLOUR);
+        PROFILE_BEGIN(PROF_AUTOPILOT);
+        action = snek_bot_choose(&bot, &sim);
+        PROFILE_END(PROF_AUTOPILOT);
     }
-    /* Draw power‑up icons on the HUD if active. */
-    int icon_y = 8;
-    int icon_x = FB_WIDTH / 2 - 32;
-    if (phase_timer > 0)
+    /* Advance the game; effects follow its events. */
+    PROFILE_BEGIN(PROF_STEP);
+    unsigned events = snek_sim_step(&sim, action);
+    PROFILE_END(PROF_STEP);
+    if (sim.over)
+        state = STATE_GAMEOVER;
+    if (!effects)
+        return;
+    if (sound_enabled)
     {
-        /* Small diamond representing phasing in HUD */
-        for (int y = 0; y < 12; y++)
-        {
-            for (int x = 0; x < 12; x++)
-            {
-                int dx = abs(x - 6);
-                int dy = abs(y - 6);
-                int draw_x = icon_x + x;
-                int draw_y = icon_y + y;
-                if (dx + dy < 6)
-                {
-                    if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                        video_buffer[draw_y * FB_WIDTH + draw_x] = PHASE_COLOUR;
-                }
-            }
-        }
-        icon_x += 16;
+        if (events & SNEK_EVENT_DIED)
+            audio_play(&voices, SOUND_GAMEOVER);
+        else if (events & (SNEK_EVENT_PHASE | SNEK_EVENT_SPEED))
+            audio_play(&voices, SOUND_POWERUP);
+        else if (events & SNEK_EVENT_FOOD)
+            audio_play(&voices, SOUND_EAT);
+    }
+    int hx = snek_sim_seg_x(&sim, 0);
+    int hy = snek_sim_seg_y(&sim, 0);
+    if (events & SNEK_EVENT_FOOD)
+        spawn_particles(hx, hy, FOOD_COLOUR);
+    if (events & SNEK_EVENT_PHASE)
+        spawn_particles(hx, hy, PHASE_COLOUR);
+    if (events & SNEK_EVENT_SPEED)
+        spawn_particles(hx, hy, SPEED_COLOUR);
+    /* Update particles. */
+    PROFILE_BEGIN(PROF_PARTICLES);
+    update_particles();
+    PROFILE_END(PROF_PARTICLES);
+}
+
+/* ------------------------------------------------------------------
+ * Input movies
+ *
+ * snek_movie=record records the buttons of every frame from the moment
+ * it is chosen, together with a save state of that moment, and writes
+ * them to snek.movie in the save directory when recording stops. play
+ * and loop read that file back, restore its state and replay the
+ * buttons instead of the controller; loop starts over at the end, for
+ * attract mode. With snek_movie_seek=end, play jumps straight to the
+ * last frame, running only the game logic on the way: no drawing and
+ * no effects, so a long game replays in a fraction of a second.
+ *
+ * The movie's position is part of the save state. Rewind, run-ahead
+ * and netplay load states over and over and run the frames again;
+ * loading one drops what was recorded after it, or moves playback back
+ * to it, so each frame is recorded or replayed once.
+ */
+typedef enum
+{
+    MOVIE_OFF,
+    MOVIE_RECORD,
+    MOVIE_PLAY,
+    MOVIE_LOOP
+} movie_mode_t;
+
+#define MOVIE_FILE "snek.movie"
+
+static movie_mode_t movie_mode = MOVIE_OFF;
+/* The snek_movie option as last read. The mode drops to off when a
+ * movie ends or fails; only a change of the option itself starts the
+ * next one. */
+static movie_mode_t movie_option = MOVIE_OFF;
+static bool movie_seek_end = false;
+static movie_t movie;
+
+static void movie_message(const char *text)
+{
+    struct retro_message msg = {text, 180};
+    env_cb(RETRO_ENVIRONMENT_SET_MESSAGE, &msg);
+}
+
+static FILE *movie_open(const char *mode)
+{
+    char path[4096];
+    const char *dir = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY, &dir) && dir && *dir)
+        snprintf(path, sizeof(path), "%s/%s", dir, MOVIE_FILE);
+    else
+        snprintf(path, sizeof(path), "%s", MOVIE_FILE);
+    return fopen(path, mode);
+}
+
+static bool movie_start_recording(void)
+{
+    size_t size = retro_serialize_size();
+    void *state = malloc(size);
+    bool ok = state && retro_serialize(state, size) && movie_begin(&movie, state, size);
+    free(state);
+    if (!ok)
+        movie_free(&movie);
+    return ok;
+}
+
+static void movie_stop_recording(void)
+{
+    FILE *file = movie_open("wb");
+    bool ok = file && movie_write(&movie, file);
+    if (file && fclose(file) != 0)
+        ok = false;
+    movie_message(ok ? "Movie saved" : "Could not save the movie");
+    movie_free(&movie);
+}
+
+/* Run the game logic up to the given movie frame. */
+static void movie_fast_forward(uint32_t target)
+{
+    unsigned buttons;
+    while (movie.cursor < target && movie_play(&movie, &buttons))
+    {
+        game_frame(buttons, false);
+        frame_count++;
     }
-    if (speed_timer > 0)
+    particles.count = 0;
+    audio_stop(&voices);
+    render_invalidate();
+}
+
+static bool movie_start_playback(void)
+{
+    FILE *file = movie_open("rb");
+    bool ok = file && movie_read(&movie, file) && retro_unserialize(movie.state, movie.state_size);
+    if (file)
+        fclose(file);
+    if (!ok)
     {
-        /* Small lightning bolt */
-        for (int y = 0; y < 12; y++)
-        {
-            for (int x = 0; x < 12; x++)
-            {
-                bool fill = false;
-                int draw_x = icon_x + x;
-                int draw_y = icon_y + y;
-                if (y < 4 && x > 6)
-                    fill = true;
-                else if (y >= 4 && y < 8 && x < 6)
-                    fill = true;
-                else if (y >= 8 && x > 6)
-                    fill = true;
-                if (fill)
-                    if (draw_x >= 0 && draw_x < FB_WIDTH && draw_y >= 0 && draw_y < FB_HEIGHT)
-                        video_buffer[draw_y * FB_WIDTH + draw_x] = SPEED_COLOUR;
-            }
-        }
+        movie_free(&movie);
+        movie_message("Could not load the movie");
     }
+    return ok;
 }
 
-/* Draw the semi‑transparent game over overlay. Darkens the screen
- * slightly and prints a message in the centre. */
-static void draw_gameover_overlay(void)
+static void movie_set_mode(movie_mode_t mode)
 {
-    /* Darken background by blending with black. */
-    for (int y = 0; y < FB_HEIGHT; y++)
+    if (movie_mode == MOVIE_RECORD)
+        movie_stop_recording();
+    else
+        movie_free(&movie);
+    movie_mode = MOVIE_OFF;
+    if (mode == MOVIE_RECORD && movie_start_recording())
+        movie_mode = MOVIE_RECORD;
+    else if ((mode == MOVIE_PLAY || mode == MOVIE_LOOP) && movie_start_playback())
     {
-        for (int x = 0; x < FB_WIDTH; x++)
-        {
-            colour_t c = video_buffer[y * FB_WIDTH + x];
-            uint8_t r = (c >> 16) & 0xFF;
-            uint8_t g = (c >> 8) & 0xFF;
-            uint8_t b = c & 0xFF;
-            r = (uint8_t)(r * 0.4f);
-            g = (uint8_t)(g * 0.4f);
-            b = (uint8_t)(b * 0.4f);
-            video_buffer[y * FB_WIDTH + x] = (r << 16) | (g << 8) | b;
-        }
+        movie_mode = mode;
+        if (mode == MOVIE_PLAY && movie_seek_end && movie.frames > 0)
+            movie_fast_forward(movie.frames - 1);
     }
-    /* Draw "GAME OVER" text centred. */
-    const char *msg = "GAME OVER";
-    int msg_len = (int)strlen(msg);
-    int px = (FB_WIDTH - msg_len * 8) / 2;
-    int py = FB_HEIGHT / 2 - 20;
-    draw_text(px, py, msg, GAMEOVER_COLOUR);
-    const char *ins = "PRESS START";
-    int ins_len = (int)strlen(ins);
-    px = (FB_WIDTH - ins_len * 8) / 2;
-    py += 20;
-    draw_text(px, py, ins, HUD_TEXT_COLOUR);
 }
 
-/* Clear the framebuffer with a vertical gradient background. */
-static void clear_background(void)
+/* Where the movie stands, for the save state: the frames recorded so
+ * far, or the frame playback is at. */
+static uint32_t movie_position(void)
+{
+    if (movie_mode == MOVIE_RECORD)
+        return movie.frames;
+    if (movie_mode == MOVIE_PLAY || movie_mode == MOVIE_LOOP)
+        return movie.cursor;
+    return 0;
+}
+
+/* Take the movie back to the position of a state just loaded. A state
+ * from after the end of the recording cannot be continued from, so the
+ * recording stops there. */
+static void movie_restore(uint32_t position)
+{
+    if (movie_mode == MOVIE_RECORD)
+    {
+        if (position <= movie.frames)
+            movie_truncate(&movie, position);
+        else
+            movie_set_mode(MOVIE_OFF);
+    }
+    else if (movie_mode == MOVIE_PLAY || movie_mode == MOVIE_LOOP)
+        movie_seek(&movie, position);
+}
+
+/* The buttons for this frame: recorded, or replaced by the movie. */
+static unsigned movie_input(unsigned buttons)
 {
-    for (int y = 0; y < FB_HEIGHT; y++)
+    if (movie_mode == MOVIE_RECORD)
     {
-        float t = (float)y / (float)FB_HEIGHT;
-        colour_t c = lerp_colour(BG_COLOUR_TOP, BG_COLOUR_BOTTOM, t);
-        for (int x = 0; x < FB_WIDTH; x++)
+        if (!movie_record(&movie, buttons))
+            movie_set_mode(MOVIE_OFF);
+    }
+    else if (movie_mode == MOVIE_PLAY || movie_mode == MOVIE_LOOP)
+    {
+        unsigned played;
+        if (movie_play(&movie, &played))
+            return played;
+        if (movie_mode == MOVIE_LOOP && retro_unserialize(movie.state, movie.state_size))
         {
-            video_buffer[y * FB_WIDTH + x] = c;
+            movie_rewind(&movie);
+            if (movie_play(&movie, &played))
+                return played;
         }
+        movie_set_mode(MOVIE_OFF);
+        movie_message("Movie finished");
     }
+    return buttons;
 }
 
-/* Draw the entire frame: background, particles, snake, food, item,
- * HUD and overlays. */
-static void draw_frame(void)
+/* Largest framebuffer announced to the frontend so far; geometry
+ * changes up to it only need SET_GEOMETRY. Zero until
+ * retro_get_system_av_info() was called. */
+static int av_max_width = 0;
+static int av_max_height = 0;
+
+/* Read core options from the frontend. A new board size starts a new
+ * game on the title screen. */
+static void check_variables(void)
 {
-    clear_background();
-    /* Draw particles first so objects draw on top. */
-    for (int i = 0; i < MAX_PARTICLES; i++)
+    int w, h, cell;
+    geometry_from_options(&w, &h, &cell);
+    if (w != grid_w || h != grid_h || cell != cell_size)
     {
-        if (particles[i].active)
+        /* Out of memory: go back to the board we had, or failing that
+         * the default one. With none at all there is nothing to run
+         * until the options change again. */
+        int old_w = grid_w, old_h = grid_h, old_cell = cell_size;
+        if (!geometry_apply(w, h, cell))
+        {
+            struct retro_message msg = {"Not enough memory for that board size", 180};
+            env_cb(RETRO_ENVIRONMENT_SET_MESSAGE, &msg);
+            if (!old_cell || !geometry_apply(old_w, old_h, old_cell))
+                geometry_apply(DEFAULT_GRID_W, DEFAULT_GRID_H, DEFAULT_CELL_SIZE);
+        }
+        if (!grid_cells)
+            return;
+        state = STATE_TITLE;
+        game_reset();
+        if (av_max_width)
         {
-            int px = (int)particles[i].x;
-            int py = (int)particles[i].y;
-            if (px >= 0 && px < FB_WIDTH && py >= 0 && py < FB_HEIGHT)
+            struct retro_system_av_info av;
+            if (fb_width <= av_max_width && fb_height <= av_max_height)
             {
-                video_buffer[py * FB_WIDTH + px] = particles[i].colour;
+                retro_get_system_av_info(&av);
+                env_cb(RETRO_ENVIRONMENT_SET_GEOMETRY, &av.geometry);
+            }
+            else
+            {
+                retro_get_system_av_info(&av);
+                env_cb(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &av);
             }
         }
     }
-    draw_snake();
-    draw_food();
-    draw_item();
-    draw_obstacles();
-    draw_scoreboard();
-    if (state == STATE_GAMEOVER)
+
+    struct retro_variable var = {"snek_render_mode", NULL};
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
     {
-        draw_gameover_overlay();
+        bool incremental = (strcmp(var.value, "full") != 0);
+        if (incremental != render_incremental)
+        {
+            render_incremental = incremental;
+            render_invalidate();
+        }
     }
-    else if (state == STATE_PAUSE)
+    var.key = "snek_render_threads";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
     {
-        /* Darken background and draw "PAUSED" */
-        for (int y = 0; y < FB_HEIGHT; y++)
+        int threads = strcmp(var.value, "auto") == 0 ? 0 : atoi(var.value);
+        if (threads < 0)
+            threads = 1;
+        if (threads != render_threads)
+        {
+            render_threads = threads;
+            render_pool_setup();
+        }
+    }
+    var.key = "snek_frontend_framebuffer";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+        frontend_fb_enabled = (strcmp(var.value, "disabled") != 0);
+    var.key = "snek_particles";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        int capacity = atoi(var.value);
+        if (capacity >= DEFAULT_PARTICLES && capacity <= MAX_PARTICLES && capacity != particles.capacity &&
+            !particle_pool_setup(capacity))
+            particle_pool_setup(DEFAULT_PARTICLES);
+    }
+    var.key = "snek_sound";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        sound_enabled = (strcmp(var.value, "disabled") != 0);
+        if (!sound_enabled)
+            audio_stop(&voices);
+    }
+    var.key = "snek_autopilot";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+        autopilot = (strcmp(var.value, "enabled") == 0);
+    var.key = "snek_refresh_rate";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        unsigned rate = (unsigned)atoi(var.value);
+        if (rate >= MIN_DISPLAY_RATE && rate != display_rate)
         {
-            for (int x = 0; x < FB_WIDTH; x++)
+            display_rate = rate;
+            tick_accumulator = 0;
+            tick_fraction = 0;
+            if (av_max_width)
             {
-                colour_t c = video_buffer[y * FB_WIDTH + x];
-                uint8_t r = (c >> 16) & 0xFF;
-                uint8_t g = (c >> 8) & 0xFF;
-                uint8_t b = c & 0xFF;
-                r = (uint8_t)(r * 0.4f);
-                g = (uint8_t)(g * 0.4f);
-                b = (uint8_t)(b * 0.4f);
-                video_buffer[y * FB_WIDTH + x] = (r << 16) | (g << 8) | b;
+                struct retro_system_av_info av;
+                retro_get_system_av_info(&av);
+                env_cb(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &av);
             }
         }
-        const char *msg = "PAUSED";
-        int len = (int)strlen(msg);
-        int px = (FB_WIDTH - len * 8) / 2;
-        int py = FB_HEIGHT / 2 - 4;
-        draw_text(px, py, msg, HUD_TEXT_COLOUR);
     }
-    else if (state == STATE_TITLE)
+    movie_mode_t mode = movie_option;
+    var.key = "snek_movie_seek";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+        movie_seek_end = (strcmp(var.value, "end") == 0);
+    var.key = "snek_movie";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
     {
-        /* Title screen: show game name and instructions. */
-        const char *title = "SNAKE";
-        int len = (int)strlen(title);
-        int px = (FB_WIDTH - len * 8) / 2;
-        int py = FB_HEIGHT / 2 - 32;
-        draw_text(px, py, title, HUD_TEXT_COLOUR);
-        const char *sub = "PRESS START";
-        len = (int)strlen(sub);
-        px = (FB_WIDTH - len * 8) / 2;
-        py += 24;
-        draw_text(px, py, sub, HUD_TEXT_COLOUR);
-        const char *inst = "ARROWS TO MOVE";
-        len = (int)strlen(inst);
-        px = (FB_WIDTH - len * 8) / 2;
-        py += 16;
-        draw_text(px, py, inst, HUD_TEXT_COLOUR);
+        if (strcmp(var.value, "record") == 0)
+            mode = MOVIE_RECORD;
+        else if (strcmp(var.value, "play") == 0)
+            mode = MOVIE_PLAY;
+        else if (strcmp(var.value, "loop") == 0)
+            mode = MOVIE_LOOP;
+        else
+            mode = MOVIE_OFF;
     }
-}
-
-/* ------------------------------------------------------------------
- * Libretro core API implementation
- */
-
-void retro_set_environment(retro_environment_t cb)
-{
-    env_cb = cb;
-    /* Provide descriptive names for controls. */
-    struct retro_input_descriptor desc[] = {
-        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP, "Up"},
-        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN, "Down"},
-        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT, "Left"},
-        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT, "Right"},
-        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START, "Start"},
-        {0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_SELECT, "Reset Highscore"},
-        {0, 0, 0, 0, NULL}};
-    env_cb(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
-
-    bool contentless = true;
-    env_cb(RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME, &contentless);
+    if (mode != movie_option)
+    {
+        movie_option = mode;
+        movie_set_mode(mode);
+    }
+#ifdef SNEK_PROFILE
+    var.key = "snek_profiler";
+    var.value = NULL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        bool overlay = (strcmp(var.value, "enabled") == 0);
+        if (overlay != profile_overlay)
+        {
+            profile_overlay = overlay;
+            render_invalidate();
+        }
+    }
+#endif
 }
 
 void retro_set_video_refresh(retro_video_refresh_t cb) { video_cb = cb; }
@@ -1414,26 +3061,49 @@ void retro_set_input_state(retro_input_state_t cb) { input_state_cb = cb; }
 
 void retro_init(void)
 {
-    /* Allocate framebuffer. */
-    video_buffer = (colour_t *)malloc(FB_WIDTH * FB_HEIGHT * sizeof(uint32_t));
-    video_pitch = FB_WIDTH * sizeof(uint32_t);
-    /* Seed RNG. */
-    srand((unsigned)time(NULL));
+#ifdef SNEK_PROFILE
+    profile_init();
+#endif
+    hud_init();
+    /* The default board in XRGB8888 until retro_load_game reads the
+     * options and negotiates the real format. */
+    geometry_apply(DEFAULT_GRID_W, DEFAULT_GRID_H, DEFAULT_CELL_SIZE);
+    particles_init();
+    particle_pool_setup(DEFAULT_PARTICLES);
+    audio_init();
+    audio_stop(&voices);
+    /* Seed the game and the effects apart. */
+    uint64_t seed = (uint64_t)time(NULL);
+    snek_rng_seed(&sim.rng_state, seed);
+    snek_rng_seed(&fx_rng_state, ~seed);
     /* Display a message via frontend environment (optional). */
     struct retro_message msg = {"Snake core loaded", 180};
     if (env_cb)
         env_cb(RETRO_ENVIRONMENT_SET_MESSAGE, &msg);
+    /* States are in native byte order, and their size follows the
+     * board and particle options. */
+    uint64_t quirks = RETRO_SERIALIZATION_QUIRK_ENDIAN_DEPENDENT | RETRO_SERIALIZATION_QUIRK_CORE_VARIABLE_SIZE;
+    if (env_cb)
+        env_cb(RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS, &quirks);
     state = STATE_TITLE;
     game_reset();
 }
 
 void retro_deinit(void)
 {
-    if (video_buffer)
-    {
-        free(video_buffer);
-        video_buffer = NULL;
-    }
+#ifdef SNEK_PROFILE
+    if (perf_cb.perf_log)
+        perf_cb.perf_log();
+#endif
+    hud_deinit();
+    geometry_deinit();
+    particle_pool_deinit();
+    render_pool_deinit();
+    render_threads = 1;
+#ifdef HAVE_OPENGL
+    hw_enabled = false;
+#endif
+    av_max_width = av_max_height = 0;
 }
 
 unsigned retro_api_version(void)
@@ -1452,26 +3122,110 @@ void retro_get_system_info(struct retro_system_info *info)
 
 void retro_get_system_av_info(struct retro_system_av_info *info)
 {
-    info->geometry.base_width = FB_WIDTH;
-    info->geometry.base_height = FB_HEIGHT;
-    info->geometry.max_width = FB_WIDTH;
-    info->geometry.max_height = FB_HEIGHT;
-    info->geometry.aspect_ratio = (float)FB_WIDTH / (float)FB_HEIGHT;
-    info->timing.fps = 60.0;
-    info->timing.sample_rate = 48000.0;
+    /* Keep the largest size announced so far as the maximum, so that
+     * shrinking the board later is a plain SET_GEOMETRY. */
+    if (fb_width > av_max_width || fb_height > av_max_height)
+    {
+        av_max_width = fb_width > av_max_width ? fb_width : av_max_width;
+        av_max_height = fb_height > av_max_height ? fb_height : av_max_height;
+    }
+    info->geometry.base_width = fb_width;
+    info->geometry.base_height = fb_height;
+    info->geometry.max_width = av_max_width;
+    info->geometry.max_height = av_max_height;
+    info->geometry.aspect_ratio = (float)fb_width / (float)fb_height;
+    info->timing.fps = (double)display_rate;
+    info->timing.sample_rate = (double)SAMPLE_RATE;
 }
 
 void retro_reset(void)
 {
     game_reset();
+    render_invalidate();
+}
+
+/* ------------------------------------------------------------------
+ * Save states
+ *
+ * The state is a small versioned record in native byte order:
+ *
+ *   header     "SNEK" magic, u16 version, u16 reserved
+ *   scalars    game state, directions, positions, timers, counters,
+ *              the game and effect RNG states, the board size, the
+ *              timestep accumulator and input latch, the queued turns,
+ *              the direction buttons, the sound voices, the
+ *              autopilot's wait and the movie position
+ *   obstacles  the obstacle bitset as stored in memory
+ *   body       length u16 cell indices, head first
+ *   particles  u16 count, then one record per live particle
+ *
+ * Only the live body and live particles are written. The rest of the
+ * buffer is zeroed, so equal game states always give equal buffers and
+ * rewind deltas stay small. retro_serialize_size() reports the largest
+ * possible state for the current board. Bump STATE_VERSION whenever the
+ * layout changes; states with a different magic or version, or from a
+ * board of another size, are rejected.
+ *
+ * Rollback and runahead load a state only a few frames old, over and
+ * over. Loading goes through snek_sim_restore(), which only touches
+ * the cells that differ from the running game, and the renderer
+ * repaints just those cells instead of the whole picture. When the
+ * frontend promises that a state stays within this session and binary
+ * (savestate_fast()), the zeroing of the unused tail and the per-item
+ * validation are skipped as well. */
+#define STATE_MAGIC 0x4B454E53u /* "SNEK" read as little endian */
+#define STATE_VERSION 10
+
+#define STATE_HEADER_SIZE (4 + 2 + 2)
+#define STATE_SCALARS_SIZE (5 * 1 + 4 * 2 + 2 * 2 + 5 * 4 + 8 + 8 + 8 + 2 * 2 + 2 * 2 + 1 + SNEK_TURN_QUEUE + 1 + \
+                            2 + 5 * AUDIO_VOICES + 2 + 4)
+#define STATE_OBSTACLES_SIZE (GRID_WORDS * sizeof(uint32_t))
+#define STATE_PARTICLE_SIZE (4 * 4 + 4 + 4)
+#define STATE_MAX_SIZE (STATE_HEADER_SIZE + STATE_SCALARS_SIZE + STATE_OBSTACLES_SIZE + \
+                        2 * grid_cells + 2 + STATE_PARTICLE_SIZE * (size_t)particles.capacity)
+
+/* Whether states taken or loaded now are guaranteed to come from and
+ * go to this binary in this session, as for runahead. */
+static bool savestate_fast(void)
+{
+    int context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+    if (env_cb(RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT, &context))
+        return context == RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE ||
+               context == RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_BINARY;
+    int av = 0;
+    return env_cb(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av) && (av & RETRO_AV_ENABLE_FAST_SAVESTATES);
+}
+
+static inline void state_put(uint8_t **ptr, const void *src, size_t n)
+{
+    memcpy(*ptr, src, n);
+    *ptr += n;
 }
 
-/* Save state serialization. We simply store all relevant state in a
- * linear buffer. The format is not intended to be stable and may
- * change in future versions. */
+static inline void state_get(const uint8_t **ptr, void *dst, size_t n)
+{
+    memcpy(dst, *ptr, n);
+    *ptr += n;
+}
+
+#define STATE_PUT(ptr, type, value)      \
+    do                                   \
+    {                                    \
+        type state_tmp_ = (type)(value); \
+        state_put(ptr, &state_tmp_, sizeof(type)); \
+    } while (0)
+
+#define STATE_GET(ptr, type, dst)        \
+    do                                   \
+    {                                    \
+        type state_tmp_;                 \
+        state_get(ptr, &state_tmp_, sizeof(type)); \
+        (dst) = state_tmp_;              \
+    } while (0)
+
 size_t retro_serialize_size(void)
 {
-    return sizeof(int) * (2 * MAX_SNAKE_LENGTH + 5) + sizeof(game_state_t) + sizeof(unsigned long);
+    return STATE_MAX_SIZE;
 }
 
 /* Required by libretro API: set controller type for a port. */
@@ -1484,81 +3238,220 @@ void retro_set_controller_port_device(unsigned port, unsigned device)
 
 bool retro_serialize(void *data, size_t size)
 {
-    size_t needed = retro_serialize_size();
-    if (size < needed)
+    if (size < STATE_MAX_SIZE || !grid_cells)
         return false;
     uint8_t *ptr = (uint8_t *)data;
-    memcpy(ptr, snake_x, sizeof(int) * MAX_SNAKE_LENGTH);
-    ptr += sizeof(int) * MAX_SNAKE_LENGTH;
-    memcpy(ptr, snake_y, sizeof(int) * MAX_SNAKE_LENGTH);
-    ptr += sizeof(int) * MAX_SNAKE_LENGTH;
-    memcpy(ptr, &snake_length, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &snake_dir, sizeof(direction_t));
-    ptr += sizeof(direction_t);
-    memcpy(ptr, &food_x, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &food_y, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &item_type, sizeof(item_type_t));
-    ptr += sizeof(item_type_t);
-    memcpy(ptr, &item_x, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &item_y, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &phase_timer, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &speed_timer, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &score, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &highscore, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &state, sizeof(game_state_t));
-    ptr += sizeof(game_state_t);
-    memcpy(ptr, &move_counter, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(ptr, &frame_count, sizeof(unsigned long));
+
+    STATE_PUT(&ptr, uint32_t, STATE_MAGIC);
+    STATE_PUT(&ptr, uint16_t, STATE_VERSION);
+    STATE_PUT(&ptr, uint16_t, 0);
+
+    STATE_PUT(&ptr, uint8_t, state);
+    STATE_PUT(&ptr, uint8_t, sim.dir);
+    STATE_PUT(&ptr, uint8_t, sim.pending_dir);
+    STATE_PUT(&ptr, uint8_t, sim.item_type);
+    STATE_PUT(&ptr, uint8_t, (prev_start ? 1 : 0) | (prev_select ? 2 : 0));
+    STATE_PUT(&ptr, int16_t, sim.food_x);
+    STATE_PUT(&ptr, int16_t, sim.food_y);
+    STATE_PUT(&ptr, int16_t, sim.item_x);
+    STATE_PUT(&ptr, int16_t, sim.item_y);
+    STATE_PUT(&ptr, uint16_t, sim.length);
+    STATE_PUT(&ptr, uint16_t, sim.obstacle_count);
+    STATE_PUT(&ptr, int32_t, sim.phase_timer);
+    STATE_PUT(&ptr, int32_t, sim.speed_timer);
+    STATE_PUT(&ptr, int32_t, sim.move_counter);
+    STATE_PUT(&ptr, int32_t, sim.score);
+    STATE_PUT(&ptr, int32_t, sim.highscore);
+    STATE_PUT(&ptr, uint64_t, frame_count);
+    STATE_PUT(&ptr, uint64_t, sim.rng_state);
+    STATE_PUT(&ptr, uint64_t, fx_rng_state);
+    STATE_PUT(&ptr, uint16_t, grid_w);
+    STATE_PUT(&ptr, uint16_t, grid_h);
+    STATE_PUT(&ptr, uint16_t, tick_accumulator);
+    STATE_PUT(&ptr, uint16_t, input_latch);
+    STATE_PUT(&ptr, uint8_t, sim.turn_count);
+    for (int i = 0; i < SNEK_TURN_QUEUE; i++)
+        STATE_PUT(&ptr, uint8_t, i < sim.turn_count ? sim.turns[i] : 0);
+    STATE_PUT(&ptr, uint8_t, prev_dirs | retry_dirs << 4);
+    STATE_PUT(&ptr, uint16_t, audio_accumulator);
+    for (int v = 0; v < AUDIO_VOICES; v++)
+    {
+        STATE_PUT(&ptr, uint8_t, voices.sound[v]);
+        STATE_PUT(&ptr, uint32_t, voices.pos[v]);
+    }
+    STATE_PUT(&ptr, uint16_t, autopilot_wait);
+    STATE_PUT(&ptr, uint32_t, movie_position());
+
+    state_put(&ptr, sim.obstacle_bits, STATE_OBSTACLES_SIZE);
+    for (int i = 0; i < sim.length; i++)
+        STATE_PUT(&ptr, uint16_t, snek_sim_seg_cell(&sim, i));
+
+    /* Particles in pool order, which decides the draw order. */
+    STATE_PUT(&ptr, uint16_t, particles.count);
+    for (int i = 0; i < particles.count; i++)
+    {
+        STATE_PUT(&ptr, int32_t, particles.x[i]);
+        STATE_PUT(&ptr, int32_t, particles.y[i]);
+        STATE_PUT(&ptr, int32_t, particles.vx[i]);
+        STATE_PUT(&ptr, int32_t, particles.vy[i]);
+        STATE_PUT(&ptr, int32_t, particles.lifetime[i]);
+        STATE_PUT(&ptr, uint32_t, particles.colour[i]);
+    }
+
+    if (!savestate_fast())
+        memset(ptr, 0, STATE_MAX_SIZE - (size_t)(ptr - (uint8_t *)data));
     return true;
 }
 
 bool retro_unserialize(const void *data, size_t size)
 {
-    size_t needed = retro_serialize_size();
-    if (size < needed)
+    if (size < STATE_HEADER_SIZE + STATE_SCALARS_SIZE + STATE_OBSTACLES_SIZE)
         return false;
     const uint8_t *ptr = (const uint8_t *)data;
-    memcpy(snake_x, ptr, sizeof(int) * MAX_SNAKE_LENGTH);
-    ptr += sizeof(int) * MAX_SNAKE_LENGTH;
-    memcpy(snake_y, ptr, sizeof(int) * MAX_SNAKE_LENGTH);
-    ptr += sizeof(int) * MAX_SNAKE_LENGTH;
-    memcpy(&snake_length, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&snake_dir, ptr, sizeof(direction_t));
-    ptr += sizeof(direction_t);
-    memcpy(&food_x, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&food_y, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&item_type, ptr, sizeof(item_type_t));
-    ptr += sizeof(item_type_t);
-    memcpy(&item_x, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&item_y, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&phase_timer, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&speed_timer, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&score, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&highscore, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&state, ptr, sizeof(game_state_t));
-    ptr += sizeof(game_state_t);
-    memcpy(&move_counter, ptr, sizeof(int));
-    ptr += sizeof(int);
-    memcpy(&frame_count, ptr, sizeof(unsigned long));
+    const uint8_t *end = ptr + size;
+
+    uint32_t magic;
+    uint16_t version, reserved;
+    STATE_GET(&ptr, uint32_t, magic);
+    STATE_GET(&ptr, uint16_t, version);
+    STATE_GET(&ptr, uint16_t, reserved);
+    (void)reserved;
+    if (magic != STATE_MAGIC || version != STATE_VERSION)
+        return false;
+
+    /* Decode and validate everything before touching the game, so a
+     * rejected state leaves the running game as it was. */
+    uint8_t st, dir, pdir, item, buttons;
+    int16_t fx, fy, ix, iy;
+    uint16_t length, obstacles;
+    int32_t phase, speed, counter, sc, hi;
+    uint64_t frames, rng, fx_rng;
+    uint16_t board_w, board_h, accumulator, latch;
+    uint8_t turn_count, turns[SNEK_TURN_QUEUE], dir_buttons;
+    uint16_t audio_owed, wait;
+    uint32_t movie_at;
+    audio_voices_t sounds;
+    STATE_GET(&ptr, uint8_t, st);
+    STATE_GET(&ptr, uint8_t, dir);
+    STATE_GET(&ptr, uint8_t, pdir);
+    STATE_GET(&ptr, uint8_t, item);
+    STATE_GET(&ptr, uint8_t, buttons);
+    STATE_GET(&ptr, int16_t, fx);
+    STATE_GET(&ptr, int16_t, fy);
+    STATE_GET(&ptr, int16_t, ix);
+    STATE_GET(&ptr, int16_t, iy);
+    STATE_GET(&ptr, uint16_t, length);
+    STATE_GET(&ptr, uint16_t, obstacles);
+    STATE_GET(&ptr, int32_t, phase);
+    STATE_GET(&ptr, int32_t, speed);
+    STATE_GET(&ptr, int32_t, counter);
+    STATE_GET(&ptr, int32_t, sc);
+    STATE_GET(&ptr, int32_t, hi);
+    STATE_GET(&ptr, uint64_t, frames);
+    STATE_GET(&ptr, uint64_t, rng);
+    STATE_GET(&ptr, uint64_t, fx_rng);
+    STATE_GET(&ptr, uint16_t, board_w);
+    STATE_GET(&ptr, uint16_t, board_h);
+    STATE_GET(&ptr, uint16_t, accumulator);
+    STATE_GET(&ptr, uint16_t, latch);
+    STATE_GET(&ptr, uint8_t, turn_count);
+    for (int i = 0; i < SNEK_TURN_QUEUE; i++)
+        STATE_GET(&ptr, uint8_t, turns[i]);
+    STATE_GET(&ptr, uint8_t, dir_buttons);
+    STATE_GET(&ptr, uint16_t, audio_owed);
+    for (int v = 0; v < AUDIO_VOICES; v++)
+    {
+        STATE_GET(&ptr, uint8_t, sounds.sound[v]);
+        STATE_GET(&ptr, uint32_t, sounds.pos[v]);
+        if (!audio_voice_valid(sounds.sound[v], sounds.pos[v]))
+            return false;
+    }
+    STATE_GET(&ptr, uint16_t, wait);
+    STATE_GET(&ptr, uint32_t, movie_at);
+    if (wait < 1 || wait > AUTOPILOT_WAIT)
+        return false;
+    if (board_w != grid_w || board_h != grid_h)
+        return false;
+    if (st > STATE_GAMEOVER || dir > SNEK_DIR_RIGHT || pdir > SNEK_DIR_RIGHT || item > SNEK_ITEM_SPEED)
+        return false;
+    if (turn_count > SNEK_TURN_QUEUE)
+        return false;
+    for (int i = 0; i < turn_count; i++)
+        if (turns[i] > SNEK_DIR_RIGHT)
+            return false;
+    if (length < 1 || length > grid_cells)
+        return false;
+    if (!(fx == -1 && fy == -1) && (fx < 0 || fx >= grid_w || fy < 0 || fy >= grid_h))
+        return false;
+    if (item != SNEK_ITEM_NONE && (ix < 0 || ix >= grid_w || iy < 0 || iy >= grid_h))
+        return false;
+
+    const uint8_t *bits = ptr;
+    ptr += STATE_OBSTACLES_SIZE;
+    if ((size_t)(end - ptr) < 2u * length + 2u)
+        return false;
+    state_get(&ptr, state_body, 2u * length);
+    uint16_t live;
+    STATE_GET(&ptr, uint16_t, live);
+    if (live > particles.capacity || (size_t)(end - ptr) < (size_t)live * STATE_PARTICLE_SIZE)
+        return false;
+    if (!savestate_fast())
+    {
+        for (int i = 0; i < length; i++)
+            if (state_body[i] >= grid_cells)
+                return false;
+        for (int i = 0; i < live; i++)
+        {
+            int32_t lifetime;
+            memcpy(&lifetime, ptr + i * STATE_PARTICLE_SIZE + 4 * 4, sizeof(lifetime));
+            if (lifetime < 1 || lifetime > PARTICLE_FADE_FRAMES)
+                return false;
+        }
+    }
+
+    state = (game_state_t)st;
+    sim.dir = (snek_dir_t)dir;
+    sim.pending_dir = (snek_dir_t)pdir;
+    prev_start = buttons & 1;
+    prev_select = (buttons >> 1) & 1;
+    sim.obstacle_count = obstacles;
+    sim.phase_timer = phase;
+    sim.speed_timer = speed;
+    sim.move_counter = counter;
+    sim.score = sc;
+    sim.highscore = hi;
+    frame_count = (unsigned long)frames;
+    sim.rng_state = rng;
+    fx_rng_state = fx_rng;
+    /* A state from another refresh rate starts on a tick. */
+    tick_accumulator = accumulator < display_rate ? accumulator : 0;
+    tick_fraction = (int32_t)(((uint64_t)tick_accumulator << 16) / display_rate);
+    input_latch = latch;
+    sim.turn_count = turn_count;
+    for (int i = 0; i < turn_count; i++)
+        sim.turns[i] = (snek_dir_t)turns[i];
+    prev_dirs = dir_buttons & 15;
+    retry_dirs = dir_buttons >> 4;
+    audio_accumulator = audio_owed < display_rate ? audio_owed : 0;
+    voices = sounds;
+    autopilot_wait = wait;
+    sim.over = (state == STATE_GAMEOVER);
+    snek_sim_restore(&sim, state_body, length, fx, fy, (snek_item_t)item, ix, iy, bits);
+    snek_bot_invalidate(&bot);
+
+    particles.count = live;
+    for (int i = 0; i < live; i++)
+    {
+        STATE_GET(&ptr, int32_t, particles.x[i]);
+        STATE_GET(&ptr, int32_t, particles.y[i]);
+        STATE_GET(&ptr, int32_t, particles.vx[i]);
+        STATE_GET(&ptr, int32_t, particles.vy[i]);
+        STATE_GET(&ptr, int32_t, particles.lifetime[i]);
+        STATE_GET(&ptr, uint32_t, particles.colour[i]);
+    }
+
+    movie_restore(movie_at);
+    render_reload();
     return true;
 }
 
@@ -1577,11 +3470,45 @@ bool retro_load_game(const struct retro_game_info *info)
 {
     /* This core does not require external content. Accept NULL info. */
     (void)info;
-    /* Request XRGB8888 pixel format. */
-    /* Needs to happen here */
-    unsigned fmt = RETRO_PIXEL_FORMAT_XRGB8888;
-    env_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt);
-    return true;
+    /* Request the pixel format. Needs to happen here; the option is
+     * only read once, so changing it takes a restart. RGB565 falls
+     * back to XRGB8888 if the frontend refuses it. */
+    surface_format_t format = SURFACE_XRGB8888;
+    bool hardware = false;
+#ifdef HAVE_OPENGL
+    /* Likewise the renderer. The GPU draws from XRGB8888 layers, so the
+     * pixel format does not apply; without a context it falls back to
+     * software drawing. */
+    struct retro_variable var = {"snek_renderer", NULL};
+    hw_enabled = env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value &&
+                 strcmp(var.value, "hardware") == 0 && hw_render_setup();
+    hardware = hw_enabled;
+    var.key = "snek_pixel_format";
+    var.value = NULL;
+#else
+    struct retro_variable var = {"snek_pixel_format", NULL};
+#endif
+    if (!hardware && env_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && strcmp(var.value, "rgb565") == 0)
+    {
+        unsigned fmt = RETRO_PIXEL_FORMAT_RGB565;
+        if (env_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
+            format = SURFACE_RGB565;
+    }
+    if (format == SURFACE_XRGB8888)
+    {
+        unsigned fmt = RETRO_PIXEL_FORMAT_XRGB8888;
+        env_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt);
+    }
+    if (format != pixel_format && grid_cells && !video_setup(format))
+        geometry_deinit();
+    if (!env_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe))
+        can_dupe = false;
+    struct retro_audio_buffer_status_callback status = {audio_buffer_status};
+    audio_status_active = false;
+    env_cb(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, &status);
+    check_variables();
+    /* No board fitted in memory. */
+    return grid_cells != 0;
 }
 
 bool retro_load_game_special(unsigned game_type, const struct retro_game_info *info, size_t num_info)
@@ -1595,7 +3522,11 @@ bool retro_load_game_special(unsigned game_type, const struct retro_game_info *i
 
 void retro_unload_game(void)
 {
-    /* Nothing to unload. */
+    /* Finish a recording in progress. */
+    movie_set_mode(MOVIE_OFF);
+    movie_option = MOVIE_OFF;
+    env_cb(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, NULL);
+    audio_status_active = false;
 }
 
 unsigned retro_get_region(void)
@@ -1617,41 +3548,147 @@ size_t retro_get_memory_size(unsigned id)
     return 0;
 }
 
-/* Execute one frame. Handles input, updates timers, moves the
- * snake at the configured speed, updates particles, draws the
- * framebuffer and outputs audio. */
+#ifdef SNEK_PROFILE
+/* The statistics as a table under the HUD, in microseconds. Drawn
+ * after the frame, so it is not part of any stage but the whole
+ * frame. */
+static void draw_profile_overlay(void)
+{
+    int x = 8;
+    int y = HUD_BOTTOM + 4;
+    blit_fill_rect(&screen, x - 4, y - 4, 32 * 8, (PROF_STAGES + 1) * 10 + 6, native_colour(RGB(0, 0, 0)));
+    draw_text(&screen, x, y, "STAGE         MIN    AVG    P99", HUD_TEXT_COLOUR);
+    for (int s = 0; s < PROF_STAGES; s++)
+    {
+        char line[48];
+        const prof_stats_t *st = &profile_shown[s];
+        snprintf(line, sizeof(line), "%-10s %6.2f %6.2f %6.2f", prof_stage_names[s],
+                 st->min / 1000.0, st->avg / 1000.0, st->p99 / 1000.0);
+        y += 10;
+        draw_text(&screen, x, y, line, HUD_TEXT_COLOUR);
+    }
+}
+#endif
+
+/* Most audio frames handed over in one retro_run(): a frame at the
+ * lowest display rate, and the most audio_batch_frames() adds. */
+#define AUDIO_MAX_BATCH (SAMPLE_RATE / MIN_DISPLAY_RATE + SAMPLE_RATE / MIN_DISPLAY_RATE / AUDIO_BATCH_ADJUST)
+/* How far the batch may stray from the nominal size: 1/64, which the
+ * frontend's rate control absorbs without an audible pitch change. */
+#define AUDIO_BATCH_ADJUST 64
+
+/* Frames to hand over for a frame's worth of audio: a little more
+ * while the frontend's buffer runs low, a little less while it is
+ * nearly full, so it settles around half full. */
+static unsigned audio_batch_frames(unsigned frames)
+{
+    if (!audio_status_active)
+        return frames;
+    if (audio_underrun_likely || audio_occupancy < 25)
+        return frames + frames / AUDIO_BATCH_ADJUST;
+    if (audio_occupancy > 75)
+        return frames - frames / AUDIO_BATCH_ADJUST;
+    return frames;
+}
+
+/* Execute one frame. Handles input, runs the game ticks that are due,
+ * draws the framebuffer and outputs audio. */
 void retro_run(void)
 {
-    handle_input();
-    if (state == STATE_PLAY)
-    {
-        /* Update timers. */
-        if (phase_timer > 0)
-            phase_timer--;
-        if (speed_timer > 0)
-            speed_timer--;
-        /* Determine movement interval based on speed boost. */
-        int interval = BASE_MOVE_INTERVAL;
-        if (speed_timer > 0)
-            interval = BASE_MOVE_INTERVAL / 2;
-        /* Countdown until the next step. */
-        move_counter--;
-        if (move_counter <= 0)
+    bool updated = false;
+    if (env_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
+        check_variables();
+    if (!grid_cells)
+        return;
+    PROFILE_BEGIN(PROF_FRAME);
+    PROFILE_BEGIN(PROF_INPUT);
+    unsigned buttons = read_input();
+    PROFILE_END(PROF_INPUT);
+    input_latch |= buttons;
+    bool ticked = false;
+    tick_accumulator += TICK_RATE;
+    while (tick_accumulator >= display_rate)
+    {
+        tick_accumulator -= display_rate;
+        game_frame(movie_input(ticked ? buttons : input_latch), true);
+        frame_count++;
+        ticked = true;
+    }
+    if (ticked)
+        input_latch = 0;
+    tick_fraction = (int32_t)(((uint64_t)tick_accumulator << 16) / display_rate);
+    /* Run-ahead and similar features run frames whose output the
+     * frontend throws away. Frontends without the call want both.
+     * Skipping a frame is safe for the incremental renderer: it diffs
+     * against the last frame it actually drew. */
+    int av_enable = RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO;
+    if (!env_cb(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable))
+        av_enable = RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO;
+    if (av_enable & RETRO_AV_ENABLE_VIDEO)
+    {
+        /* Nothing visible changed: let the frontend reuse the last
+         * frame, or resend our buffer which still holds it. */
+#ifdef SNEK_PROFILE
+        /* The overlay changes every frame and covers whatever is
+         * beneath it. */
+        if (profile_overlay)
+            render_invalidate();
+#endif
+        bool changed = render_needed();
+        if (!changed && can_dupe)
+        {
+            PROFILE_BEGIN(PROF_VIDEO);
+            video_cb(NULL, fb_width, fb_height, video_pitch);
+            PROFILE_END(PROF_VIDEO);
+        }
+#ifdef HAVE_OPENGL
+        else if (hw_enabled)
+        {
+            /* The frontend's framebuffer is not kept between frames. */
+            render_frame();
+            PROFILE_BEGIN(PROF_VIDEO);
+            video_cb(hw_ready ? RETRO_HW_FRAME_BUFFER_VALID : NULL, fb_width, fb_height, 0);
+            PROFILE_END(PROF_VIDEO);
+        }
+#endif
+        else
         {
-            update_snake();
-            move_counter = interval;
+            if (changed || screen_external)
+            {
+                /* Draw everything. */
+                select_render_target();
+                render_frame();
+#ifdef SNEK_PROFILE
+                if (profile_overlay)
+                    draw_profile_overlay();
+#endif
+            }
+            /* Send video frame to frontend. */
+            PROFILE_BEGIN(PROF_VIDEO);
+            video_cb(screen.pixels, fb_width, fb_height, video_pitch);
+            PROFILE_END(PROF_VIDEO);
         }
-        /* Update particles. */
-        update_particles();
-    }
-    /* Draw everything. */
-    draw_frame();
-    /* Send video frame to frontend. */
-    video_cb(video_buffer, FB_WIDTH, FB_HEIGHT, video_pitch);
-    /* Generate silent audio. We output exactly 1 frame worth of samples per video frame. */
-    /* For 48000 Hz sample rate and 60 fps: samples_per_frame = 48000 / 60 = 800 stereo frames (1600 samples) */
-    static int16_t silence[1600];
-    memset(silence, 0, sizeof(silence));
-    audio_batch_cb(silence, 800); /* 800 stereo samples (1600 total samples) */
-    frame_count++;
+    }
+    /* One video frame's worth of audio: 800 stereo frames at 60 Hz,
+     * with the remainder carried over at rates that do not divide the
+     * sample rate. The voices always move on by that much, heard or
+     * not, so that run-ahead frames leave the same sound behind. */
+    audio_accumulator += SAMPLE_RATE;
+    unsigned frames = audio_accumulator / display_rate;
+    audio_accumulator -= frames * display_rate;
+    if (av_enable & RETRO_AV_ENABLE_AUDIO)
+    {
+        static const int16_t silence[2 * AUDIO_MAX_BATCH];
+        static int16_t mixed[2 * AUDIO_MAX_BATCH];
+        unsigned out_frames = audio_batch_frames(frames);
+        if (audio_mix(&voices, mixed, out_frames, frames))
+            audio_batch_cb(mixed, out_frames);
+        else
+            audio_batch_cb(silence, out_frames);
+    }
+    audio_advance(&voices, frames);
+    PROFILE_END(PROF_FRAME);
+#ifdef SNEK_PROFILE
+    profile_frame_end();
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,452 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Autopilot. See snek_bot.h.
+ */
+#include "snek_bot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Field values: walls, and cells the food cannot be reached from.
+ * Distances are stored plus one, so the food is 1. */
+#define WALL 0
+#define FAR 0xFFFF
+
+/* Whether the game counts a board cell as a wall: an obstacle or a
+ * segment. */
+static bool sim_blocks(const snek_sim_t *sim, int cell)
+{
+    return ((sim->obstacle_bits[cell >> 5] >> (cell & 31)) & 1u) || sim->occupancy[cell];
+}
+
+/* Padded cell of a board cell. */
+static int padded(const snek_sim_t *sim, int cell)
+{
+    return cell + cell / sim->grid_w + sim->grid_w + 2;
+}
+
+/* Offsets of the neighbours, in snek_dir_t order. */
+static void offsets(const snek_bot_t *bot, int out[4])
+{
+    out[SNEK_DIR_UP] = -bot->stride;
+    out[SNEK_DIR_DOWN] = bot->stride;
+    out[SNEK_DIR_LEFT] = -1;
+    out[SNEK_DIR_RIGHT] = 1;
+}
+
+/* A fresh visit stamp for bot->mark. */
+static uint32_t next_stamp(snek_bot_t *bot)
+{
+    if (++bot->stamp == 0)
+    {
+        memset(bot->mark, 0, (size_t)bot->cells * sizeof(uint32_t));
+        bot->stamp = 1;
+    }
+    return bot->stamp;
+}
+
+bool snek_bot_init(snek_bot_t *bot, const snek_sim_t *sim)
+{
+    memset(bot, 0, sizeof(*bot));
+    bot->stride = sim->grid_w + 1;
+    bot->cells = bot->stride * (sim->grid_h + 2);
+    if (bot->cells > 0xFFFF)
+        return false;
+    size_t cells = (size_t)bot->cells;
+    bot->dist = (uint16_t *)malloc(cells * sizeof(uint16_t));
+    bot->queue = (uint16_t *)malloc(cells * sizeof(uint16_t));
+    bot->order = (uint16_t *)malloc(cells * sizeof(uint16_t));
+    bot->seeds = (uint32_t *)malloc(2 * cells * sizeof(uint32_t));
+    bot->mark = (uint32_t *)calloc(cells, sizeof(uint32_t));
+    if (!bot->dist || !bot->queue || !bot->order || !bot->seeds || !bot->mark)
+    {
+        snek_bot_free(bot);
+        return false;
+    }
+    return true;
+}
+
+void snek_bot_free(snek_bot_t *bot)
+{
+    free(bot->dist);
+    free(bot->queue);
+    free(bot->order);
+    free(bot->seeds);
+    free(bot->mark);
+    memset(bot, 0, sizeof(*bot));
+}
+
+void snek_bot_invalidate(snek_bot_t *bot)
+{
+    bot->valid = false;
+}
+
+/* ------------------------------------------------------------------
+ * Distance field
+ *
+ * The field holds the BFS distances to the food over the open cells.
+ * Opening a cell can only shorten distances, so a breadth-first wave
+ * from it fixes them. Blocking one can only lengthen the distances of
+ * the cells whose every shortest path ran through it. Those are found
+ * level by level (a cell is cut off when none of its neighbours one
+ * step nearer is left) and then filled in again from the cells around
+ * them. Walls are 0, so a wave never enters them and they never look
+ * one step nearer than anything but the food.
+ */
+
+/* Relax outwards from the count cells in bot->queue, nearest first. */
+static void spread(snek_bot_t *bot, int count)
+{
+    uint16_t *dist = bot->dist, *queue = bot->queue;
+    int off[4];
+    offsets(bot, off);
+    int head = 0;
+    while (head < count)
+    {
+        int u = queue[head++];
+        uint16_t d = (uint16_t)(dist[u] + 1);
+        for (int k = 0; k < 4; k++)
+        {
+            int v = u + off[k];
+            if (d < dist[v])
+            {
+                dist[v] = d;
+                queue[count++] = (uint16_t)v;
+            }
+        }
+    }
+}
+
+/* One more than the distance of the nearest neighbour of u, or FAR. */
+static uint32_t nearest(const snek_bot_t *bot, const int off[4], int u)
+{
+    uint32_t best = FAR;
+    for (int k = 0; k < 4; k++)
+    {
+        uint32_t d = bot->dist[u + off[k]];
+        if (d != WALL && d + 1 < best)
+            best = d + 1;
+    }
+    return best;
+}
+
+static void field_rebuild(snek_bot_t *bot, const snek_sim_t *sim)
+{
+    memset(bot->dist, 0, (size_t)bot->cells * sizeof(uint16_t));
+    for (int cell = 0; cell < sim->grid_cells; cell++)
+        if (!sim_blocks(sim, cell))
+            bot->dist[padded(sim, cell)] = FAR;
+    if (bot->food >= 0 && bot->dist[bot->food] != WALL)
+    {
+        bot->dist[bot->food] = 1;
+        bot->queue[0] = (uint16_t)bot->food;
+        spread(bot, 1);
+    }
+}
+
+static void field_open(snek_bot_t *bot, int cell)
+{
+    int off[4];
+    offsets(bot, off);
+    uint32_t best = cell == bot->food ? 1 : nearest(bot, off, cell);
+    bot->dist[cell] = (uint16_t)best;
+    if (best == FAR)
+        return;
+    bot->queue[0] = (uint16_t)cell;
+    spread(bot, 1);
+}
+
+/* Sort seeds by their distance, the top 16 bits: an insertion sort
+ * for the usual handful, else a radix sort through scratch. */
+static void sort_seeds(uint32_t *seeds, uint32_t *scratch, int count)
+{
+    if (count <= 32)
+    {
+        for (int i = 1; i < count; i++)
+        {
+            uint32_t seed = seeds[i];
+            int j = i;
+            for (; j > 0 && seeds[j - 1] > seed; j--)
+                seeds[j] = seeds[j - 1];
+            seeds[j] = seed;
+        }
+        return;
+    }
+    for (int shift = 16; shift < 32; shift += 8)
+    {
+        int start[257] = {0};
+        for (int i = 0; i < count; i++)
+            start[((seeds[i] >> shift) & 0xFF) + 1]++;
+        for (int b = 0; b < 256; b++)
+            start[b + 1] += start[b];
+        for (int i = 0; i < count; i++)
+            scratch[start[(seeds[i] >> shift) & 0xFF]++] = seeds[i];
+        uint32_t *swap = seeds;
+        seeds = scratch;
+        scratch = swap;
+    }
+}
+
+static void field_block(snek_bot_t *bot, int cell)
+{
+    uint16_t *dist = bot->dist, *queue = bot->queue;
+    int off[4];
+    offsets(bot, off);
+    uint16_t level = dist[cell];
+    dist[cell] = WALL;
+    if (level == FAR)
+        return;
+
+    /* Find the cells cut off, nearest first: every candidate is one
+     * step further than the cut-off cell that queued it, so a level is
+     * settled before the next is looked at. Cut-off cells go to FAR at
+     * once, which is what makes them fail as support. */
+    uint32_t stamp = next_stamp(bot);
+    int head = 0, tail = 0, lost = 0;
+    queue[tail++] = (uint16_t)cell;
+    while (head < tail)
+    {
+        int u = queue[head++];
+        if (u != cell)
+        {
+            level = dist[u];
+            bool supported = false;
+            for (int k = 0; k < 4 && !supported; k++)
+                supported = dist[u + off[k]] + 1 == level;
+            if (supported)
+                continue;
+            dist[u] = FAR;
+            bot->order[lost++] = (uint16_t)u;
+        }
+        for (int k = 0; k < 4; k++)
+        {
+            int v = u + off[k];
+            if (dist[v] == level + 1 && bot->mark[v] != stamp)
+            {
+                bot->mark[v] = stamp;
+                queue[tail++] = (uint16_t)v;
+            }
+        }
+    }
+
+    /* Give each cut-off cell the best distance through the cells that
+     * kept theirs, then spread from these seeds in order of distance,
+     * merged with the wave they start. A seed is distance << 16 | cell,
+     * so sorting them sorts by distance. */
+    uint32_t *seeds = bot->seeds;
+    int seed_count = 0;
+    for (int i = 0; i < lost; i++)
+    {
+        uint32_t best = nearest(bot, off, bot->order[i]);
+        if (best != FAR)
+            seeds[seed_count++] = best << 16 | bot->order[i];
+    }
+    sort_seeds(seeds, seeds + bot->cells, seed_count);
+    head = tail = 0;
+    int next = 0;
+    while (next < seed_count || head < tail)
+    {
+        int u;
+        if (head < tail && (next == seed_count || dist[queue[head]] <= seeds[next] >> 16))
+            u = queue[head++];
+        else
+        {
+            u = (int)(seeds[next] & 0xFFFF);
+            uint16_t d = (uint16_t)(seeds[next++] >> 16);
+            /* Already reached from a nearer seed. */
+            if (d >= dist[u])
+                continue;
+            dist[u] = d;
+        }
+        uint16_t d = (uint16_t)(dist[u] + 1);
+        for (int k = 0; k < 4; k++)
+        {
+            int v = u + off[k];
+            if (d < dist[v])
+            {
+                dist[v] = d;
+                queue[tail++] = (uint16_t)v;
+            }
+        }
+    }
+}
+
+/* Bring a board cell of the field in line with the game. */
+static void field_sync(snek_bot_t *bot, const snek_sim_t *sim, int cell)
+{
+    int p = padded(sim, cell);
+    bool blocks = sim_blocks(sim, cell);
+    if (blocks != (bot->dist[p] == WALL))
+    {
+        if (blocks)
+            field_block(bot, p);
+        else
+            field_open(bot, p);
+    }
+}
+
+static void field_update(snek_bot_t *bot, const snek_sim_t *sim)
+{
+    int food = sim->food_x >= 0 ? padded(sim, sim->food_y * sim->grid_w + sim->food_x) : -1;
+    int head = snek_sim_seg_cell(sim, 0);
+    int tail = snek_sim_seg_cell(sim, sim->length - 1);
+    if (!bot->valid || bot->generation != sim->obstacle_generation || bot->food != food)
+    {
+        bot->food = food;
+        field_rebuild(bot, sim);
+    }
+    else if (head != bot->head_cell || tail != bot->tail_cell || sim->length != bot->length)
+    {
+        /* One move on: the new head took a cell and the old tail may
+         * have left one. Anything else is a different board. */
+        bool moved = sim->length >= 2 && snek_sim_seg_cell(sim, 1) == bot->head_cell &&
+                     (sim->length == bot->length || sim->length == bot->length + 1);
+        if (moved)
+        {
+            field_sync(bot, sim, head);
+            field_sync(bot, sim, bot->tail_cell);
+        }
+        else
+            field_rebuild(bot, sim);
+    }
+    bot->valid = true;
+    bot->generation = sim->obstacle_generation;
+    bot->head_cell = head;
+    bot->tail_cell = tail;
+    bot->length = sim->length;
+}
+
+/* ------------------------------------------------------------------
+ * Room to move
+ */
+
+/* Whether the open neighbours of cell stay connected to each other
+ * around it once it is blocked, so that blocking it cannot split the
+ * free space. Two side neighbours are linked through the corner
+ * between them when that is open too. */
+static bool ring_connected(const snek_bot_t *bot, int cell)
+{
+    /* Clockwise from up, so side k and side k + 1 share a corner. */
+    const int sides[4] = {-bot->stride, 1, bot->stride, -1};
+    int count = 0, links = 0;
+    for (int k = 0; k < 4; k++)
+    {
+        int side = cell + sides[k], next = sides[(k + 1) & 3];
+        if (bot->dist[side] == WALL)
+            continue;
+        count++;
+        if (bot->dist[side + next] != WALL && bot->dist[cell + next] != WALL)
+            links++;
+    }
+    /* Four links close the ring and count once more than needed. */
+    return count - links <= 1;
+}
+
+/* Open cells flooded from start, stopping at limit. */
+static int flood(snek_bot_t *bot, const int off[4], int start, uint32_t stamp, int limit)
+{
+    uint16_t *queue = bot->queue;
+    int head = 0, tail = 0;
+    bot->mark[start] = stamp;
+    queue[tail++] = (uint16_t)start;
+    while (head < tail && tail < limit)
+    {
+        int u = queue[head++];
+        for (int k = 0; k < 4; k++)
+        {
+            int v = u + off[k];
+            if (bot->dist[v] != WALL && bot->mark[v] != stamp)
+            {
+                bot->mark[v] = stamp;
+                queue[tail++] = (uint16_t)v;
+            }
+        }
+    }
+    return tail < limit ? tail : limit;
+}
+
+/* Room the head has after stepping into target, up to limit cells:
+ * the largest part of the free space next to target once target is
+ * taken, plus target itself. */
+static int room(snek_bot_t *bot, int target, bool shared, int limit)
+{
+    /* All moves lead into the same free space and this one cannot
+     * split it, so it leaves as much room as any move can. */
+    if (shared && ring_connected(bot, target))
+        return limit;
+    int off[4];
+    offsets(bot, off);
+    uint32_t stamp = next_stamp(bot);
+    bot->mark[target] = stamp;
+    int best = 0;
+    for (int k = 0; k < 4 && best + 1 < limit; k++)
+    {
+        int v = target + off[k];
+        if (bot->dist[v] != WALL && bot->mark[v] != stamp)
+        {
+            int n = flood(bot, off, v, stamp, limit);
+            if (n > best)
+                best = n;
+        }
+    }
+    return best + 1 < limit ? best + 1 : limit;
+}
+
+int snek_bot_choose(snek_bot_t *bot, const snek_sim_t *sim)
+{
+    if (sim->over)
+        return SNEK_ACTION_NONE;
+    field_update(bot, sim);
+
+    /* The moves open to the head, nearest to the food first, then
+     * straight on before turning. */
+    int off[4];
+    offsets(bot, off);
+    int head = padded(sim, snek_sim_seg_cell(sim, 0));
+    int moves[3];
+    uint32_t keys[3];
+    int count = 0;
+    for (int dir = SNEK_DIR_UP; dir <= SNEK_DIR_RIGHT; dir++)
+    {
+        uint16_t d = bot->dist[head + off[dir]];
+        if (dir == (int)(sim->dir ^ 1) || d == WALL)
+            continue;
+        uint32_t key = (uint32_t)d << 1 | (dir != (int)sim->dir);
+        int at = count++;
+        for (; at > 0 && keys[at - 1] > key; at--)
+        {
+            moves[at] = moves[at - 1];
+            keys[at] = keys[at - 1];
+        }
+        moves[at] = dir;
+        keys[at] = key;
+    }
+    if (!count)
+        return SNEK_ACTION_NONE;
+
+    /* Take the first move that leaves the snake its length in room,
+     * else the one that leaves the most. */
+    bool shared = ring_connected(bot, head);
+    int best = moves[0], best_room = -1;
+    for (int i = 0; i < count; i++)
+    {
+        int r = room(bot, head + off[moves[i]], shared, sim->length);
+        if (r >= sim->length)
+            return moves[i];
+        if (r > best_room)
+        {
+            best = moves[i];
+            best_room = r;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,81 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Autopilot for a snek_sim_t.
+ *
+ * The bot keeps the distance from every cell to the food, counting
+ * obstacles and snake segments as walls, and steers the head down that
+ * field. The field is updated where the board changed since the last
+ * call rather than rebuilt: a move blocks the new head cell and
+ * usually frees the tail cell, and each of those only disturbs the
+ * distances that ran through it. New food or obstacles still rebuild
+ * it, once per food eaten.
+ *
+ * Before taking a step the bot checks that it leaves enough room: if
+ * the target cell may cut the free space in two, the part the head
+ * ends up in must hold at least the snake's length. A cell whose free
+ * neighbours stay connected around it cannot cut anything, so in open
+ * space the check costs a look at eight cells.
+ *
+ * The distances are a function of the board alone, however they were
+ * reached, so the choices follow from the game state like everything
+ * else in it. That is also why a move's work is not capped or spread
+ * over several calls: a move costs about a microsecond on a 40x30
+ * board, but on 240x180 it averages around 14, most of it in the
+ * rebuild after each food.
+ */
+#ifndef SNEK_BOT_H
+#define SNEK_BOT_H
+
+#include "snek_sim.h"
+
+typedef struct
+{
+    /* The field covers the board plus a border of walls, one ahead of
+     * the first row, one after the last and one column shared by both
+     * sides, so a neighbour is always a fixed offset away. stride is
+     * grid_w + 1 and cells the padded count. */
+    int stride, cells;
+    /* Per padded cell: 0 for a wall, else one more than the steps to
+     * the food, or 0xFFFF if the food cannot be reached. */
+    uint16_t *dist;
+    /* Scratch: a queue, a list of cells, distance-keyed seeds (twice
+     * cells, for sorting) and visit stamps. */
+    uint16_t *queue;
+    uint16_t *order;
+    uint32_t *seeds;
+    uint32_t *mark;
+    uint32_t stamp;
+
+    /* What the field was built for: obstacle_generation, the padded
+     * food cell (-1 for none), and the board cells of the head and
+     * tail. */
+    bool valid;
+    unsigned generation;
+    int food;
+    int head_cell, tail_cell, length;
+} snek_bot_t;
+
+/* Allocate a bot for the board of sim. Returns false if memory runs
+ * out or the padded board has more than 65535 cells. */
+bool snek_bot_init(snek_bot_t *bot, const snek_sim_t *sim);
+void snek_bot_free(snek_bot_t *bot);
+
+/* Rebuild the field on the next call, e.g. after the game was replaced
+ * by a save state. */
+void snek_bot_invalidate(snek_bot_t *bot);
+
+/* Bring the field up to date with sim and pick the direction of the
+ * next move: towards the food if that leaves room, else into the most
+ * room. Returns a snek_dir_t, or SNEK_ACTION_NONE to keep going. */
+int snek_bot_choose(snek_bot_t *bot, const snek_sim_t *sim);
+
+#endif
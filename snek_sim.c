@@ -0,0 +1,610 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Snek game rules. See snek_sim.h.
+ */
+#include "snek_sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Probability that a power‑up is spawned when food is consumed, in
+ * 1/256 steps. 128 is a 50 percent chance. */
+#define POWERUP_CHANCE 128
+
+static inline int popcount32(uint32_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount(v);
+#else
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    return (int)((((v + (v >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+#endif
+}
+
+/* Index of the lowest set bit; v must not be 0. */
+static inline int ctz32(uint32_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(v);
+#else
+    int n = 0;
+    while (!(v & 1u))
+    {
+        v >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Obstacle bit of an in-bounds cell. */
+static inline bool obstacle_bit(const snek_sim_t *sim, int idx)
+{
+    return (sim->obstacle_bits[idx >> 5] >> (idx & 31)) & 1u;
+}
+
+static inline void set_seg(snek_sim_t *sim, int i, int x, int y)
+{
+    sim->ring[snek_sim_ring_index(sim, i)] = (uint16_t)(y * sim->grid_w + x);
+}
+
+/* ------------------------------------------------------------------
+ * Occupancy tracking
+ *
+ * The free cells are kept in a bitset indexed like the grid, so every
+ * change is O(1), and a random free cell is found by counting set bits
+ * a word at a time. The pick only depends on which cells are free,
+ * never on the order they became free, so a loaded state spawns
+ * exactly like the game it was saved from.
+ */
+static bool cell_is_free(const snek_sim_t *sim, int x, int y)
+{
+    int idx = y * sim->grid_w + x;
+    if (obstacle_bit(sim, idx) || sim->occupancy[idx])
+        return false;
+    if (sim->food_x == x && sim->food_y == y)
+        return false;
+    if (sim->item_type != SNEK_ITEM_NONE && sim->item_x == x && sim->item_y == y)
+        return false;
+    return true;
+}
+
+/* Bring the free list in line with the current contents of a cell.
+ * Call after anything in the cell changed. */
+static void occupancy_refresh(snek_sim_t *sim, int x, int y)
+{
+    if (x < 0 || x >= sim->grid_w || y < 0 || y >= sim->grid_h)
+        return;
+    int idx = y * sim->grid_w + x;
+    uint32_t bit = 1u << (idx & 31);
+    bool listed = (sim->free_bits[idx >> 5] & bit) != 0;
+    bool is_free = cell_is_free(sim, x, y);
+    if (is_free && !listed)
+    {
+        sim->free_bits[idx >> 5] |= bit;
+        sim->free_count++;
+    }
+    else if (!is_free && listed)
+    {
+        sim->free_bits[idx >> 5] &= ~bit;
+        sim->free_count--;
+    }
+}
+
+static void snake_occupy(snek_sim_t *sim, int x, int y)
+{
+    sim->occupancy[y * sim->grid_w + x]++;
+    occupancy_refresh(sim, x, y);
+}
+
+static void snake_vacate(snek_sim_t *sim, int x, int y)
+{
+    sim->occupancy[y * sim->grid_w + x]--;
+    occupancy_refresh(sim, x, y);
+}
+
+static void occupancy_rebuild(snek_sim_t *sim)
+{
+    memset(sim->occupancy, 0, (size_t)sim->grid_cells * sizeof(uint16_t));
+    for (int i = 0; i < sim->length; i++)
+        sim->occupancy[snek_sim_seg_cell(sim, i)]++;
+    memset(sim->free_bits, 0, SNEK_GRID_WORDS(sim->grid_cells) * sizeof(uint32_t));
+    sim->free_count = 0;
+    for (int idx = 0; idx < sim->grid_cells; idx++)
+    {
+        if (cell_is_free(sim, idx % sim->grid_w, idx / sim->grid_w))
+        {
+            sim->free_bits[idx >> 5] |= 1u << (idx & 31);
+            sim->free_count++;
+        }
+    }
+}
+
+void snek_sim_rebuild(snek_sim_t *sim)
+{
+    occupancy_rebuild(sim);
+    sim->obstacle_generation++;
+}
+
+/* Candidate alignments tried by body_restore(). A rollback goes back a
+ * handful of moves, so the heads are never far apart. */
+#define RESTORE_SEARCH 64
+
+/* Whether body[i] is segment i + shift of the current snake wherever
+ * both exist, and they share at least one segment. */
+static bool body_aligned(const snek_sim_t *sim, const uint16_t *body, int length, int shift)
+{
+    int lo = shift < 0 ? -shift : 0;
+    int hi = length < sim->length - shift ? length : sim->length - shift;
+    if (lo >= hi)
+        return false;
+    for (int i = lo; i < hi; i++)
+        if (body[i] != snek_sim_seg_cell(sim, i + shift))
+            return false;
+    return true;
+}
+
+/* Replace the snake by body. When the new body is the current one
+ * moved a few steps back or forth, only the cells at either end are
+ * rewritten and refreshed; the shared middle stays in the ring where it
+ * is. Otherwise every segment is replaced. */
+static void body_restore(snek_sim_t *sim, const uint16_t *body, int length)
+{
+    int w = sim->grid_w;
+    int shift = 0;
+    bool aligned = false;
+    for (int j = 0; j < RESTORE_SEARCH && j < sim->length && !aligned; j++)
+        if (snek_sim_seg_cell(sim, j) == body[0] && body_aligned(sim, body, length, j))
+        {
+            shift = j;
+            aligned = true;
+        }
+    for (int j = 1; j < RESTORE_SEARCH && j < length && !aligned; j++)
+        if (body[j] == snek_sim_seg_cell(sim, 0) && body_aligned(sim, body, length, -j))
+        {
+            shift = -j;
+            aligned = true;
+        }
+
+    /* New segments lo..hi-1 are the current ones lo+shift..hi+shift-1;
+     * with no alignment nothing is shared. */
+    int lo = 0, hi = 0;
+    if (aligned)
+    {
+        lo = shift < 0 ? -shift : 0;
+        hi = length < sim->length - shift ? length : sim->length - shift;
+    }
+    for (int i = 0; i < sim->length; i++)
+    {
+        if (i >= lo + shift && i < hi + shift)
+            continue;
+        int cell = snek_sim_seg_cell(sim, i);
+        snake_vacate(sim, cell % w, cell / w);
+    }
+    sim->head += shift;
+    if (sim->head < 0)
+        sim->head += sim->grid_cells;
+    else if (sim->head >= sim->grid_cells)
+        sim->head -= sim->grid_cells;
+    sim->length = length;
+    for (int i = 0; i < length; i++)
+    {
+        if (i >= lo && i < hi)
+            continue;
+        sim->ring[snek_sim_ring_index(sim, i)] = body[i];
+        snake_occupy(sim, body[i] % w, body[i] / w);
+    }
+}
+
+void snek_sim_restore(snek_sim_t *sim, const uint16_t *body, int length, int food_x, int food_y,
+                      snek_item_t item_type, int item_x, int item_y, const void *obstacle_bits)
+{
+    size_t bits_size = SNEK_GRID_WORDS(sim->grid_cells) * sizeof(uint32_t);
+    if (memcmp(sim->obstacle_bits, obstacle_bits, bits_size) != 0)
+    {
+        /* A different layout means a different game; start over. */
+        memcpy(sim->obstacle_bits, obstacle_bits, bits_size);
+        sim->head = 0;
+        sim->length = length;
+        memcpy(sim->ring, body, (size_t)length * sizeof(uint16_t));
+        sim->food_x = food_x;
+        sim->food_y = food_y;
+        sim->item_type = item_type;
+        sim->item_x = item_x;
+        sim->item_y = item_y;
+        snek_sim_rebuild(sim);
+        return;
+    }
+    int old_food_x = sim->food_x, old_food_y = sim->food_y;
+    bool old_item = sim->item_type != SNEK_ITEM_NONE;
+    int old_item_x = sim->item_x, old_item_y = sim->item_y;
+    sim->food_x = food_x;
+    sim->food_y = food_y;
+    sim->item_type = item_type;
+    sim->item_x = item_x;
+    sim->item_y = item_y;
+    body_restore(sim, body, length);
+    occupancy_refresh(sim, old_food_x, old_food_y);
+    occupancy_refresh(sim, food_x, food_y);
+    if (old_item)
+        occupancy_refresh(sim, old_item_x, old_item_y);
+    if (item_type != SNEK_ITEM_NONE)
+        occupancy_refresh(sim, item_x, item_y);
+}
+
+/* Pick a random free cell: one without an obstacle, snake segment,
+ * food or power‑up. Returns false if the board is full. */
+static bool random_free_cell(snek_sim_t *sim, int *out_x, int *out_y)
+{
+    if (sim->free_count == 0)
+        return false;
+    int k = (int)snek_rng_below(&sim->rng_state, (uint32_t)sim->free_count);
+    int word = 0;
+    while (k >= popcount32(sim->free_bits[word]))
+        k -= popcount32(sim->free_bits[word++]);
+    /* Drop the k lowest set bits; the next one is the pick. */
+    uint32_t bits = sim->free_bits[word];
+    while (k-- > 0)
+        bits &= bits - 1;
+    int bit = 0;
+    while (!(bits & (1u << bit)))
+        bit++;
+    int idx = word * 32 + bit;
+    *out_x = idx % sim->grid_w;
+    *out_y = idx / sim->grid_w;
+    return true;
+}
+
+/* Spawn food at a random free location. Returns false, leaving no
+ * food on the board, if there is no free cell left. */
+static bool spawn_food(snek_sim_t *sim)
+{
+    int old_x = sim->food_x;
+    int old_y = sim->food_y;
+    int x = -1, y = -1;
+    bool placed = random_free_cell(sim, &x, &y);
+    sim->food_x = x;
+    sim->food_y = y;
+    occupancy_refresh(sim, old_x, old_y);
+    occupancy_refresh(sim, sim->food_x, sim->food_y);
+    return placed;
+}
+
+/* Spawn a power‑up with a random type and position. Only spawn if
+ * none is currently active. The chance of spawning is governed by
+ * POWERUP_CHANCE. */
+static void spawn_item(snek_sim_t *sim)
+{
+    if (sim->item_type != SNEK_ITEM_NONE)
+        return;
+    if ((snek_rng_next(&sim->rng_state) >> 24) >= POWERUP_CHANCE)
+        return;
+    /* Decide which item to spawn. We currently choose between
+     * phasing and speed boost with equal probability. */
+    snek_item_t type = snek_rng_below(&sim->rng_state, 2) ? SNEK_ITEM_PHASE : SNEK_ITEM_SPEED;
+    int x, y;
+    if (!random_free_cell(sim, &x, &y))
+        return;
+    sim->item_type = type;
+    sim->item_x = x;
+    sim->item_y = y;
+    occupancy_refresh(sim, x, y);
+}
+
+static void place_obstacle(snek_sim_t *sim, int x, int y)
+{
+    int idx = y * sim->grid_w + x;
+    sim->obstacle_bits[idx >> 5] |= 1u << (idx & 31);
+    occupancy_refresh(sim, x, y);
+}
+
+/* Wall in the board and scatter obstacles inside it. */
+static void spawn_obstacles(snek_sim_t *sim)
+{
+    int w = sim->grid_w;
+    int h = sim->grid_h;
+    for (int x = 0; x < w; x++)
+    {
+        place_obstacle(sim, x, 0);
+        place_obstacle(sim, x, h - 1);
+    }
+    for (int y = 0; y < h; y++)
+    {
+        place_obstacle(sim, 0, y);
+        place_obstacle(sim, w - 1, y);
+    }
+    sim->obstacle_count = 2 * (w + h) - 4;
+    int num_obstacles = w * h / 100;
+    for (int i = 0; i < num_obstacles; i++)
+    {
+        int x, y;
+        if (!random_free_cell(sim, &x, &y))
+            break;
+        place_obstacle(sim, x, y);
+        sim->obstacle_count++;
+    }
+    sim->obstacle_generation++;
+}
+
+static bool board_size_valid(int grid_w, int grid_h)
+{
+    return grid_w >= 4 && grid_h >= 4 && grid_w * grid_h <= SNEK_MAX_CELLS;
+}
+
+bool snek_sim_init_with(snek_sim_t *sim, int grid_w, int grid_h, uint64_t seed, uint16_t *ring,
+                        uint16_t *occupancy, uint32_t *obstacle_bits, uint32_t *free_bits)
+{
+    memset(sim, 0, sizeof(*sim));
+    if (!board_size_valid(grid_w, grid_h))
+        return false;
+    sim->grid_w = grid_w;
+    sim->grid_h = grid_h;
+    sim->grid_cells = grid_w * grid_h;
+    size_t words = SNEK_GRID_WORDS(sim->grid_cells);
+    sim->ring = ring;
+    sim->occupancy = occupancy;
+    sim->obstacle_bits = obstacle_bits;
+    sim->free_bits = free_bits;
+    memset(occupancy, 0, (size_t)sim->grid_cells * sizeof(uint16_t));
+    memset(obstacle_bits, 0, words * sizeof(uint32_t));
+    memset(free_bits, 0, words * sizeof(uint32_t));
+    snek_rng_seed(&sim->rng_state, seed);
+    snek_sim_reset(sim);
+    return true;
+}
+
+bool snek_sim_init(snek_sim_t *sim, int grid_w, int grid_h, uint64_t seed)
+{
+    memset(sim, 0, sizeof(*sim));
+    if (!board_size_valid(grid_w, grid_h))
+        return false;
+    size_t cells = (size_t)(grid_w * grid_h);
+    size_t words = SNEK_GRID_WORDS(cells);
+    uint16_t *ring = (uint16_t *)malloc(cells * sizeof(uint16_t));
+    uint16_t *occupancy = (uint16_t *)malloc(cells * sizeof(uint16_t));
+    uint32_t *obstacle_bits = (uint32_t *)malloc(words * sizeof(uint32_t));
+    uint32_t *free_bits = (uint32_t *)malloc(words * sizeof(uint32_t));
+    if (!ring || !occupancy || !obstacle_bits || !free_bits)
+    {
+        free(ring);
+        free(occupancy);
+        free(obstacle_bits);
+        free(free_bits);
+        return false;
+    }
+    return snek_sim_init_with(sim, grid_w, grid_h, seed, ring, occupancy, obstacle_bits, free_bits);
+}
+
+void snek_sim_free(snek_sim_t *sim)
+{
+    free(sim->ring);
+    free(sim->occupancy);
+    free(sim->obstacle_bits);
+    free(sim->free_bits);
+    memset(sim, 0, sizeof(*sim));
+}
+
+/* Initialise a new game. Resets the snake, spawns obstacles and food
+ * and resets timers and counters. */
+void snek_sim_reset(snek_sim_t *sim)
+{
+    int w = sim->grid_w;
+    int h = sim->grid_h;
+    sim->head = 0;
+    sim->length = 3;
+    set_seg(sim, 0, w / 2, h / 2);
+    set_seg(sim, 1, w / 2 - 1, h / 2);
+    set_seg(sim, 2, w / 2 - 2, h / 2);
+    sim->dir = SNEK_DIR_RIGHT;
+    sim->pending_dir = SNEK_DIR_RIGHT;
+    sim->turn_count = 0;
+    sim->score = 0;
+    sim->phase_timer = 0;
+    sim->speed_timer = 0;
+    sim->item_type = SNEK_ITEM_NONE;
+    sim->move_counter = SNEK_MOVE_INTERVAL;
+    sim->over = false;
+    memset(sim->obstacle_bits, 0, SNEK_GRID_WORDS(sim->grid_cells) * sizeof(uint32_t));
+    sim->obstacle_count = 0;
+    sim->food_x = sim->food_y = -1;
+    occupancy_rebuild(sim);
+    /* Obstacles first so the food never ends up inside a wall. */
+    spawn_obstacles(sim);
+    spawn_food(sim);
+}
+
+bool snek_sim_turn(snek_sim_t *sim, snek_dir_t dir)
+{
+    /* The way the snake will be going when this turn is reached. */
+    snek_dir_t last = sim->turn_count ? sim->turns[sim->turn_count - 1] : sim->pending_dir;
+    if (dir == last)
+        return true;
+    /* Directions pair up as UP/DOWN and LEFT/RIGHT, so the reverse of
+     * a direction only differs in the lowest bit. */
+    if (last == (snek_dir_t)(dir ^ 1))
+        return false;
+    /* Turns only queue up behind a pending one, so with none pending
+     * last is also the current direction. */
+    if (sim->pending_dir == sim->dir)
+    {
+        sim->pending_dir = dir;
+        return true;
+    }
+    if (sim->turn_count == SNEK_TURN_QUEUE)
+        return false;
+    sim->turns[sim->turn_count++] = dir;
+    return true;
+}
+
+/* Move the snake one cell. */
+static unsigned move_snake(snek_sim_t *sim)
+{
+    /* Apply pending direction at the start of the move, and bring up
+     * the next queued turn. */
+    sim->dir = sim->pending_dir;
+    if (sim->turn_count)
+    {
+        sim->pending_dir = sim->turns[0];
+        sim->turn_count--;
+        memmove(sim->turns, sim->turns + 1, (size_t)sim->turn_count * sizeof(sim->turns[0]));
+    }
+    int w = sim->grid_w;
+    int h = sim->grid_h;
+    int new_x = snek_sim_seg_x(sim, 0);
+    int new_y = snek_sim_seg_y(sim, 0);
+    switch (sim->dir)
+    {
+    case SNEK_DIR_UP:
+        new_y--;
+        break;
+    case SNEK_DIR_DOWN:
+        new_y++;
+        break;
+    case SNEK_DIR_LEFT:
+        new_x--;
+        break;
+    case SNEK_DIR_RIGHT:
+        new_x++;
+        break;
+    }
+
+    /* Check wall collisions. If the snake leaves the board and phasing
+     * is inactive the game is over. With phasing active we simply wrap
+     * around to the other side. */
+    if (sim->phase_timer > 0)
+    {
+        if (new_x < 0)
+            new_x = w - 1;
+        if (new_x >= w)
+            new_x = 0;
+        if (new_y < 0)
+            new_y = h - 1;
+        if (new_y >= h)
+            new_y = 0;
+    }
+    else if (new_x < 0 || new_x >= w || new_y < 0 || new_y >= h)
+    {
+        sim->over = true;
+        return SNEK_EVENT_DIED;
+    }
+
+    /* Check self collision. With phasing active we ignore collisions
+     * with the body. The tail still counts, as in it has not moved
+     * out of the way yet. Obstacles always count. */
+    int idx = new_y * w + new_x;
+    if ((sim->phase_timer <= 0 && sim->occupancy[idx]) || obstacle_bit(sim, idx))
+    {
+        sim->over = true;
+        return SNEK_EVENT_DIED;
+    }
+
+    /* Move body: drop the tail and push the new head onto the ring.
+     * Every other segment keeps its place. */
+    snake_vacate(sim, snek_sim_seg_x(sim, sim->length - 1), snek_sim_seg_y(sim, sim->length - 1));
+    sim->head = (sim->head == 0) ? sim->grid_cells - 1 : sim->head - 1;
+    set_seg(sim, 0, new_x, new_y);
+    snake_occupy(sim, new_x, new_y);
+    unsigned events = SNEK_EVENT_MOVED;
+
+    /* Check fruit collision. If we eat food we grow by one segment. */
+    if (new_x == sim->food_x && new_y == sim->food_y)
+    {
+        if (sim->length < sim->grid_cells)
+        {
+            /* The new segment starts on top of the tail. */
+            sim->length++;
+            int tail_x = snek_sim_seg_x(sim, sim->length - 2);
+            int tail_y = snek_sim_seg_y(sim, sim->length - 2);
+            set_seg(sim, sim->length - 1, tail_x, tail_y);
+            snake_occupy(sim, tail_x, tail_y);
+        }
+        sim->score += 10;
+        if (sim->score > sim->highscore)
+            sim->highscore = sim->score;
+        events |= SNEK_EVENT_FOOD;
+        /* No room left for food: the board is full and the game is
+         * over. */
+        if (!spawn_food(sim))
+        {
+            sim->over = true;
+            return events | SNEK_EVENT_DIED;
+        }
+        spawn_item(sim);
+    }
+
+    /* Check item collision. Activate power‑up and remove item. */
+    if (sim->item_type != SNEK_ITEM_NONE && new_x == sim->item_x && new_y == sim->item_y)
+    {
+        if (sim->item_type == SNEK_ITEM_PHASE)
+        {
+            sim->phase_timer = SNEK_PHASE_DURATION;
+            events |= SNEK_EVENT_PHASE;
+        }
+        else
+        {
+            sim->speed_timer = SNEK_SPEED_DURATION;
+            events |= SNEK_EVENT_SPEED;
+        }
+        sim->item_type = SNEK_ITEM_NONE;
+        occupancy_refresh(sim, sim->item_x, sim->item_y);
+    }
+    return events;
+}
+
+unsigned snek_sim_step(snek_sim_t *sim, int action)
+{
+    if (sim->over)
+        return 0;
+    if (action != SNEK_ACTION_NONE)
+        snek_sim_turn(sim, (snek_dir_t)action);
+    /* Update timers. */
+    if (sim->phase_timer > 0)
+        sim->phase_timer--;
+    if (sim->speed_timer > 0)
+        sim->speed_timer--;
+    /* Countdown until the next step, at double speed while boosted.
+     * The interval is taken before the move, so a boost collected on
+     * this move applies from the next one. */
+    int interval = sim->speed_timer > 0 ? SNEK_MOVE_INTERVAL / 2 : SNEK_MOVE_INTERVAL;
+    if (--sim->move_counter > 0)
+        return 0;
+    unsigned events = move_snake(sim);
+    sim->move_counter = interval;
+    return events;
+}
+
+void snek_sim_observe(const snek_sim_t *sim, uint8_t *cells)
+{
+    /* Obstacles a word of the bitset at a time; most words are empty
+     * or only hold the side walls. */
+    for (int base = 0; base < sim->grid_cells; base += 32)
+    {
+        uint32_t bits = sim->obstacle_bits[base >> 5];
+        int n = sim->grid_cells - base < 32 ? sim->grid_cells - base : 32;
+        memset(cells + base, SNEK_CELL_EMPTY, (size_t)n);
+        while (bits)
+        {
+            int b = ctz32(bits);
+            if (b < n)
+                cells[base + b] = SNEK_CELL_OBSTACLE;
+            bits &= bits - 1;
+        }
+    }
+    for (int i = sim->length - 1; i >= 0; i--)
+        cells[snek_sim_seg_cell(sim, i)] = i == 0 ? SNEK_CELL_HEAD : SNEK_CELL_BODY;
+    if (sim->food_x >= 0)
+        cells[sim->food_y * sim->grid_w + sim->food_x] = SNEK_CELL_FOOD;
+    if (sim->item_type != SNEK_ITEM_NONE)
+        cells[sim->item_y * sim->grid_w + sim->item_x] =
+            sim->item_type == SNEK_ITEM_PHASE ? SNEK_CELL_PHASE : SNEK_CELL_SPEED;
+}
@@ -0,0 +1,245 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Headless Snek simulation.
+ *
+ * The game rules without any rendering, audio or libretro callbacks.
+ * All state lives in a snek_sim_t, so any number of games can run side
+ * by side (one per thread, say) for training or balancing. The
+ * libretro core drives one of these and draws it.
+ *
+ * A game advances one frame per snek_sim_step(); the snake moves every
+ * few frames depending on its speed. The fields of snek_sim_t may be
+ * read freely but should only be changed through the functions below.
+ */
+#ifndef SNEK_SIM_H
+#define SNEK_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Directions used by the snake. */
+typedef enum
+{
+    SNEK_DIR_UP,
+    SNEK_DIR_DOWN,
+    SNEK_DIR_LEFT,
+    SNEK_DIR_RIGHT
+} snek_dir_t;
+
+/* Power‑up types. */
+typedef enum
+{
+    SNEK_ITEM_NONE = 0,
+    SNEK_ITEM_PHASE,
+    SNEK_ITEM_SPEED
+} snek_item_t;
+
+/* Action for snek_sim_step(): a snek_dir_t, or this to keep going. */
+#define SNEK_ACTION_NONE (-1)
+
+/* Events returned by snek_sim_step(), or'ed together. FOOD, PHASE and
+ * SPEED happen at the new head position. */
+#define SNEK_EVENT_MOVED 1u
+#define SNEK_EVENT_FOOD 2u
+#define SNEK_EVENT_PHASE 4u
+#define SNEK_EVENT_SPEED 8u
+#define SNEK_EVENT_DIED 16u
+
+/* Cell contents written by snek_sim_observe(). */
+enum
+{
+    SNEK_CELL_EMPTY = 0,
+    SNEK_CELL_OBSTACLE,
+    SNEK_CELL_BODY,
+    SNEK_CELL_HEAD,
+    SNEK_CELL_FOOD,
+    SNEK_CELL_PHASE,
+    SNEK_CELL_SPEED
+};
+
+/* Power‑up durations (in frames). 60 frames ≈ 1 second at 60 Hz. */
+#define SNEK_PHASE_DURATION (60 * 5) /* 5 seconds of phasing */
+#define SNEK_SPEED_DURATION (60 * 5) /* 5 seconds of speed boost */
+
+/* Movement speed. Lower values produce a faster snake because the
+ * snake advances once every SNEK_MOVE_INTERVAL frames. A speed boost
+ * halves this interval. */
+#define SNEK_MOVE_INTERVAL 8
+
+/* Turns that can wait behind the next move. */
+#define SNEK_TURN_QUEUE 3
+
+/* Cells are addressed by uint16_t indices (y * grid_w + x), which
+ * bounds the board. */
+#define SNEK_MAX_CELLS 65535
+
+typedef struct
+{
+    int grid_w, grid_h;
+    int grid_cells;
+
+    /* Snake body positions as cell indices, stored as a circular
+     * buffer of grid_cells entries so that a move only writes the new
+     * head. head is the ring index of segment 0; use the
+     * snek_sim_seg_*() accessors, where segment 0 is the head and
+     * segment length-1 the tail. */
+    uint16_t *ring;
+    int head;
+    int length;
+    /* dir is the way the snake last moved and pending_dir the way its
+     * next move goes. Turns for the moves after that wait in turns[],
+     * oldest first, so quick successive turns are all taken. */
+    snek_dir_t dir;
+    snek_dir_t pending_dir;
+    snek_dir_t turns[SNEK_TURN_QUEUE];
+    int turn_count;
+
+    /* Fruit and power‑up positions. food_x is -1 when the board has
+     * no room for food. If item_type is SNEK_ITEM_NONE no power‑up is
+     * present. */
+    int food_x, food_y;
+    snek_item_t item_type;
+    int item_x, item_y;
+
+    /* Timers for active power‑ups. When >0 the effect is active. */
+    int phase_timer;
+    int speed_timer;
+    /* Frames until the snake's next step. */
+    int move_counter;
+
+    int score;
+    int highscore;
+    /* Set when the snake crashed or the board is full. */
+    bool over;
+
+    /* Obstacle grid, one bit per cell index. obstacle_generation is
+     * bumped whenever the layout changes so that anything built from
+     * it knows when to rebuild. */
+    uint32_t *obstacle_bits;
+    int obstacle_count;
+    unsigned obstacle_generation;
+
+    /* A cell is free unless it holds an obstacle, a snake segment, the
+     * food or the power‑up. free_bits has one bit per free cell;
+     * occupancy counts segments per cell because a phasing snake may
+     * overlap itself. */
+    uint16_t *occupancy;
+    uint32_t *free_bits;
+    int free_count;
+
+    /* PCG32 state. Part of the game state, so a restored game spawns
+     * exactly like the one it was saved from. */
+    uint64_t rng_state;
+} snek_sim_t;
+
+/* Words in a bitset with one bit per cell. */
+#define SNEK_GRID_WORDS(cells) (((cells) + 31) / 32)
+
+/* Allocate a grid_w×grid_h board and start a game on it. Returns false
+ * if the size is out of range or memory runs out. */
+bool snek_sim_init(snek_sim_t *sim, int grid_w, int grid_h, uint64_t seed);
+void snek_sim_free(snek_sim_t *sim);
+
+/* Like snek_sim_init(), but on arrays the caller owns: ring and
+ * occupancy of grid_cells entries, obstacle_bits and free_bits of
+ * SNEK_GRID_WORDS(grid_cells). They stay the caller's to free; do not
+ * snek_sim_free() such a game. Lets many games share one allocation
+ * per array, as snek_vec does. */
+bool snek_sim_init_with(snek_sim_t *sim, int grid_w, int grid_h, uint64_t seed, uint16_t *ring,
+                        uint16_t *occupancy, uint32_t *obstacle_bits, uint32_t *free_bits);
+
+/* Start a new game. The high score and the random stream carry on. */
+void snek_sim_reset(snek_sim_t *sim);
+
+/* Steer the snake. The turn applies to the next move if that has not
+ * got one yet, otherwise it is queued behind the turns already
+ * waiting. A turn back onto the direction the snake will have by then
+ * is refused, as is a turn when the queue is full; asking for that
+ * direction again changes nothing. Returns whether the snake will go
+ * this way. */
+bool snek_sim_turn(snek_sim_t *sim, snek_dir_t dir);
+
+/* Advance one frame, turning first unless action is
+ * SNEK_ACTION_NONE. Returns the SNEK_EVENT_* that happened. Does
+ * nothing once the game is over. */
+unsigned snek_sim_step(snek_sim_t *sim, int action);
+
+/* Write one SNEK_CELL_* byte per cell, row by row, to cells
+ * (grid_cells bytes). */
+void snek_sim_observe(const snek_sim_t *sim, uint8_t *cells);
+
+/* Recompute the occupancy from the body, obstacles and items, e.g.
+ * after restoring them from a save state, and bump
+ * obstacle_generation. */
+void snek_sim_rebuild(snek_sim_t *sim);
+
+/* Put back a saved board: the body as length cell indices (head
+ * first), the food, the power-up and an obstacle bitset laid out like
+ * obstacle_bits (it need not be aligned). The remaining fields are
+ * plain values for the caller to set. Only the cells that differ from
+ * the current board are updated, so going back a few moves, as
+ * rollback does, costs a few cell updates rather than a rebuild.
+ * obstacle_generation is only bumped if the obstacles changed. */
+void snek_sim_restore(snek_sim_t *sim, const uint16_t *body, int length, int food_x, int food_y,
+                      snek_item_t item_type, int item_x, int item_y, const void *obstacle_bits);
+
+/* Random numbers: PCG32 (XSH-RR variant) with a fixed stream. Cheap,
+ * not shared with anything else and small enough to save. */
+static inline uint32_t snek_rng_next(uint64_t *state)
+{
+    uint64_t old = *state;
+    *state = old * 6364136223846793005ull + 1442695040888963407ull;
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t)(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+static inline void snek_rng_seed(uint64_t *state, uint64_t seed)
+{
+    *state = 0;
+    snek_rng_next(state);
+    *state += seed;
+    snek_rng_next(state);
+}
+
+/* Uniform integer in [0, bound). */
+static inline uint32_t snek_rng_below(uint64_t *state, uint32_t bound)
+{
+    return (uint32_t)(((uint64_t)snek_rng_next(state) * bound) >> 32);
+}
+
+/* Ring index of snake segment i. */
+static inline int snek_sim_ring_index(const snek_sim_t *sim, int i)
+{
+    int idx = sim->head + i;
+    return idx >= sim->grid_cells ? idx - sim->grid_cells : idx;
+}
+
+static inline int snek_sim_seg_cell(const snek_sim_t *sim, int i)
+{
+    return sim->ring[snek_sim_ring_index(sim, i)];
+}
+
+static inline int snek_sim_seg_x(const snek_sim_t *sim, int i) { return snek_sim_seg_cell(sim, i) % sim->grid_w; }
+static inline int snek_sim_seg_y(const snek_sim_t *sim, int i) { return snek_sim_seg_cell(sim, i) / sim->grid_w; }
+
+/* Obstacle bit of a cell; false outside the board. */
+static inline bool snek_sim_obstacle_at(const snek_sim_t *sim, int x, int y)
+{
+    if (x < 0 || x >= sim->grid_w || y < 0 || y >= sim->grid_h)
+        return false;
+    int idx = y * sim->grid_w + x;
+    return (sim->obstacle_bits[idx >> 5] >> (idx & 31)) & 1u;
+}
+
+#endif
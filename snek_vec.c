@@ -0,0 +1,327 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Batched Snek environments. See snek_vec.h.
+ *
+ * The games are cut into batches of SNEK_VEC_BATCH. Every thread owns a
+ * contiguous run of batches and works through it from the front; once
+ * its own run is empty it steals batches from the others, so a thread
+ * that drew cheap games (say, most of them just reset) helps out the
+ * slow ones. A run is just an atomic cursor, so taking a batch from it
+ * is the same fetch-and-add for the owner and for a thief.
+ *
+ * The games keep their arrays in four slabs, one per array: the rings
+ * of all games in one, their occupancy counts in the next, and so on.
+ * Game i's part of a slab starts i strides in. A batch then walks four
+ * contiguous blocks rather than four scattered allocations per game.
+ * Strides are whole cache lines, so threads on neighbouring batches do
+ * not share a line.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "snek_vec.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Games per batch: big enough to amortise taking it, small enough to
+ * balance the load. */
+#define SNEK_VEC_BATCH 64
+
+/* Slab strides are whole cache lines of this many bytes. */
+#define SNEK_VEC_LINE 64
+#define SNEK_VEC_LINES(bytes) (((bytes) + SNEK_VEC_LINE - 1) / SNEK_VEC_LINE * SNEK_VEC_LINE)
+
+/* One thread's run of batches, padded to its own cache line. */
+typedef struct
+{
+    atomic_int next;
+    int end;
+    char pad[64 - sizeof(atomic_int) - sizeof(int)];
+} vec_queue_t;
+
+typedef struct
+{
+    snek_vec_t *vec;
+    int index;
+    pthread_t thread;
+} vec_worker_t;
+
+struct snek_vec
+{
+    int count;
+    int grid_cells;
+    snek_sim_t *envs;
+
+    /* The games' arrays, see above. Strides in elements. */
+    uint16_t *rings, *occupancy;
+    uint32_t *obstacle_bits, *free_bits;
+    size_t cell_stride, word_stride;
+
+    int threads;
+    vec_worker_t *workers; /* threads - 1 of them; the caller is thread 0 */
+    vec_queue_t *queues;
+
+    /* The job being run. */
+    bool reset;
+    const int32_t *actions;
+    uint8_t *obs;
+    float *reward;
+    uint8_t *done;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finished;
+    unsigned generation;
+    int pending;
+    bool quit;
+};
+
+static void env_run(snek_vec_t *vec, int i)
+{
+    snek_sim_t *sim = &vec->envs[i];
+    float reward = 0.0f;
+    uint8_t done = 0;
+    if (vec->reset)
+        snek_sim_reset(sim);
+    else
+    {
+        int action = vec->actions ? vec->actions[i] : SNEK_ACTION_NONE;
+        unsigned events = snek_sim_step(sim, action);
+        while (!sim->over && !(events & SNEK_EVENT_MOVED))
+            events |= snek_sim_step(sim, SNEK_ACTION_NONE);
+        if (events & SNEK_EVENT_FOOD)
+            reward += SNEK_VEC_REWARD_FOOD;
+        if (sim->over)
+        {
+            /* Without a move the snake crashed; otherwise it filled
+             * the board. */
+            if (!(events & SNEK_EVENT_MOVED))
+                reward += SNEK_VEC_REWARD_CRASH;
+            done = 1;
+            snek_sim_reset(sim);
+        }
+    }
+    if (vec->obs)
+        snek_sim_observe(sim, vec->obs + (size_t)i * vec->grid_cells);
+    if (vec->reward)
+        vec->reward[i] = reward;
+    if (vec->done)
+        vec->done[i] = done;
+}
+
+static bool queue_take(vec_queue_t *q, int *batch)
+{
+    if (atomic_load_explicit(&q->next, memory_order_relaxed) >= q->end)
+        return false;
+    int b = atomic_fetch_add_explicit(&q->next, 1, memory_order_relaxed);
+    if (b >= q->end)
+        return false;
+    *batch = b;
+    return true;
+}
+
+/* Work through our own batches, then through everybody else's. */
+static void vec_work(snek_vec_t *vec, int self)
+{
+    for (int k = 0; k < vec->threads; k++)
+    {
+        vec_queue_t *q = &vec->queues[(self + k) % vec->threads];
+        int batch;
+        while (queue_take(q, &batch))
+        {
+            int first = batch * SNEK_VEC_BATCH;
+            int last = first + SNEK_VEC_BATCH < vec->count ? first + SNEK_VEC_BATCH : vec->count;
+            for (int i = first; i < last; i++)
+                env_run(vec, i);
+        }
+    }
+}
+
+static void *vec_worker(void *arg)
+{
+    vec_worker_t *worker = (vec_worker_t *)arg;
+    snek_vec_t *vec = worker->vec;
+    unsigned seen = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&vec->lock);
+        while (vec->generation == seen && !vec->quit)
+            pthread_cond_wait(&vec->start, &vec->lock);
+        if (vec->quit)
+        {
+            pthread_mutex_unlock(&vec->lock);
+            return NULL;
+        }
+        seen = vec->generation;
+        pthread_mutex_unlock(&vec->lock);
+
+        vec_work(vec, worker->index);
+
+        pthread_mutex_lock(&vec->lock);
+        if (--vec->pending == 0)
+            pthread_cond_signal(&vec->finished);
+        pthread_mutex_unlock(&vec->lock);
+    }
+}
+
+/* Run the current job on every game. */
+static void vec_run(snek_vec_t *vec)
+{
+    int batches = (vec->count + SNEK_VEC_BATCH - 1) / SNEK_VEC_BATCH;
+    for (int t = 0; t < vec->threads; t++)
+    {
+        atomic_store_explicit(&vec->queues[t].next, (int)((long)batches * t / vec->threads),
+                              memory_order_relaxed);
+        vec->queues[t].end = (int)((long)batches * (t + 1) / vec->threads);
+    }
+    if (vec->threads > 1)
+    {
+        /* The mutex publishes the job and the queues to the workers. */
+        pthread_mutex_lock(&vec->lock);
+        vec->pending = vec->threads - 1;
+        vec->generation++;
+        pthread_cond_broadcast(&vec->start);
+        pthread_mutex_unlock(&vec->lock);
+    }
+    vec_work(vec, 0);
+    if (vec->threads > 1)
+    {
+        pthread_mutex_lock(&vec->lock);
+        while (vec->pending > 0)
+            pthread_cond_wait(&vec->finished, &vec->lock);
+        pthread_mutex_unlock(&vec->lock);
+    }
+}
+
+snek_vec_t *snek_vec_create(int count, int grid_w, int grid_h, uint64_t seed, int threads)
+{
+    if (count < 1)
+        return NULL;
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    int batches = (count + SNEK_VEC_BATCH - 1) / SNEK_VEC_BATCH;
+    if (threads > batches)
+        threads = batches;
+
+    snek_vec_t *vec = (snek_vec_t *)calloc(1, sizeof(*vec));
+    if (!vec)
+        return NULL;
+    vec->envs = (snek_sim_t *)calloc((size_t)count, sizeof(snek_sim_t));
+    vec->queues = (vec_queue_t *)calloc((size_t)threads, sizeof(vec_queue_t));
+    vec->workers = (vec_worker_t *)calloc((size_t)threads, sizeof(vec_worker_t));
+    if (!vec->envs || !vec->queues || !vec->workers || grid_w < 1 || grid_h < 1 ||
+        grid_w * grid_h > SNEK_MAX_CELLS)
+    {
+        snek_vec_destroy(vec);
+        return NULL;
+    }
+    size_t cells = (size_t)(grid_w * grid_h);
+    vec->cell_stride = SNEK_VEC_LINES(cells * sizeof(uint16_t)) / sizeof(uint16_t);
+    vec->word_stride = SNEK_VEC_LINES(SNEK_GRID_WORDS(cells) * sizeof(uint32_t)) / sizeof(uint32_t);
+    vec->rings = (uint16_t *)aligned_alloc(SNEK_VEC_LINE, (size_t)count * vec->cell_stride * sizeof(uint16_t));
+    vec->occupancy = (uint16_t *)aligned_alloc(SNEK_VEC_LINE, (size_t)count * vec->cell_stride * sizeof(uint16_t));
+    vec->obstacle_bits = (uint32_t *)aligned_alloc(SNEK_VEC_LINE, (size_t)count * vec->word_stride * sizeof(uint32_t));
+    vec->free_bits = (uint32_t *)aligned_alloc(SNEK_VEC_LINE, (size_t)count * vec->word_stride * sizeof(uint32_t));
+    if (!vec->rings || !vec->occupancy || !vec->obstacle_bits || !vec->free_bits)
+    {
+        snek_vec_destroy(vec);
+        return NULL;
+    }
+    for (; vec->count < count; vec->count++)
+    {
+        size_t i = (size_t)vec->count;
+        if (!snek_sim_init_with(&vec->envs[i], grid_w, grid_h, seed + i, vec->rings + i * vec->cell_stride,
+                                vec->occupancy + i * vec->cell_stride, vec->obstacle_bits + i * vec->word_stride,
+                                vec->free_bits + i * vec->word_stride))
+        {
+            snek_vec_destroy(vec);
+            return NULL;
+        }
+    }
+    vec->grid_cells = grid_w * grid_h;
+
+    pthread_mutex_init(&vec->lock, NULL);
+    pthread_cond_init(&vec->start, NULL);
+    pthread_cond_init(&vec->finished, NULL);
+    vec->threads = 1;
+    for (int t = 1; t < threads; t++)
+    {
+        vec_worker_t *worker = &vec->workers[t - 1];
+        worker->vec = vec;
+        worker->index = t;
+        if (pthread_create(&worker->thread, NULL, vec_worker, worker) != 0)
+            break;
+        vec->threads++;
+    }
+    return vec;
+}
+
+void snek_vec_destroy(snek_vec_t *vec)
+{
+    if (!vec)
+        return;
+    if (vec->threads > 0)
+    {
+        pthread_mutex_lock(&vec->lock);
+        vec->quit = true;
+        pthread_cond_broadcast(&vec->start);
+        pthread_mutex_unlock(&vec->lock);
+        for (int t = 1; t < vec->threads; t++)
+            pthread_join(vec->workers[t - 1].thread, NULL);
+        pthread_cond_destroy(&vec->finished);
+        pthread_cond_destroy(&vec->start);
+        pthread_mutex_destroy(&vec->lock);
+    }
+    free(vec->rings);
+    free(vec->occupancy);
+    free(vec->obstacle_bits);
+    free(vec->free_bits);
+    free(vec->envs);
+    free(vec->queues);
+    free(vec->workers);
+    free(vec);
+}
+
+int snek_vec_count(const snek_vec_t *vec)
+{
+    return vec->count;
+}
+
+const snek_sim_t *snek_vec_env(const snek_vec_t *vec, int i)
+{
+    return &vec->envs[i];
+}
+
+void snek_vec_reset(snek_vec_t *vec, uint8_t *obs)
+{
+    vec->reset = true;
+    vec->actions = NULL;
+    vec->obs = obs;
+    vec->reward = NULL;
+    vec->done = NULL;
+    vec_run(vec);
+}
+
+void snek_vec_step(snek_vec_t *vec, const int32_t *actions, uint8_t *obs, float *reward, uint8_t *done)
+{
+    vec->reset = false;
+    vec->actions = actions;
+    vec->obs = obs;
+    vec->reward = reward;
+    vec->done = done;
+    vec_run(vec);
+}
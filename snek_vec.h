@@ -0,0 +1,55 @@
+/*
+--------------------------------------------------------------------------
+"THE BEER-WARE LICENSE" (Revision 42):
+<m4x@m4xw.net> wrote this file.
+As long as you retain this notice you can do whatever you
+want with this stuff. If you meet me some day, and you think this
+stuff is worth it, you can buy me a beer in return.
+--------------------------------------------------------------------------
+*/
+
+/*
+ * Batched Snek environments.
+ *
+ * Steps many independent snek_sim_t games with one call, spread over a
+ * pool of worker threads, and writes the results into flat arrays the
+ * caller owns (numpy buffers, say): game i uses obs[i * grid_cells],
+ * reward[i] and done[i]. A game that ends is reset right away, so its
+ * observation already shows the next game while done[i] reports the
+ * end of the old one.
+ *
+ * One step is one decision: the action is applied and the game runs
+ * until the snake has moved a cell or the game ended. Results do not
+ * depend on the number of threads.
+ */
+#ifndef SNEK_VEC_H
+#define SNEK_VEC_H
+
+#include "snek_sim.h"
+
+/* Rewards: eating food and crashing. */
+#define SNEK_VEC_REWARD_FOOD 1.0f
+#define SNEK_VEC_REWARD_CRASH -1.0f
+
+typedef struct snek_vec snek_vec_t;
+
+/* Create count games of grid_w×grid_h; game i is seeded with seed + i.
+ * threads is the number of threads stepping games, including the
+ * caller's; 0 uses one per online CPU. Returns NULL on failure. */
+snek_vec_t *snek_vec_create(int count, int grid_w, int grid_h, uint64_t seed, int threads);
+void snek_vec_destroy(snek_vec_t *vec);
+
+int snek_vec_count(const snek_vec_t *vec);
+
+/* Game i, for inspection. */
+const snek_sim_t *snek_vec_env(const snek_vec_t *vec, int i);
+
+/* Start a new game everywhere and write the observations. obs may be
+ * NULL. */
+void snek_vec_reset(snek_vec_t *vec, uint8_t *obs);
+
+/* Apply actions[i] (a snek_dir_t or SNEK_ACTION_NONE) to game i and
+ * step every game once. Any of obs, reward and done may be NULL. */
+void snek_vec_step(snek_vec_t *vec, const int32_t *actions, uint8_t *obs, float *reward, uint8_t *done);
+
+#endif